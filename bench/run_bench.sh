@@ -0,0 +1,28 @@
+#!/bin/sh
+# Builds tm_bench for every engine and capacity and prints one JSON array.
+# Usage: ./run_bench.sh [extra compiler flags]
+set -e
+cd "$(dirname "$0")"
+CC=${CC:-cc}
+OUT=$(mktemp -d)
+trap 'rm -rf "$OUT"' EXIT
+
+first=1
+echo "["
+for engine in TM_ENGINE_COUNTDOWN TM_ENGINE_WHEEL TM_ENGINE_HEAP; do
+    for bitmap in 0 1; do
+        [ "$engine" = TM_ENGINE_HEAP ] && [ "$bitmap" = 1 ] && continue
+        for tasks in 10 32 64 128 255; do
+            for timers in 5 64; do
+                "$CC" -O2 -I../taskman -DTM_ENGINE=$engine -DTM_READY_BITMAP=$bitmap \
+                    -DMAX_TASKS=$tasks -DMAX_TIMERS=$timers "$@" \
+                    tm_bench.c ../taskman/taskman.c -o "$OUT/tm_bench"
+                [ $first = 1 ] || echo ","
+                first=0
+                # strip the brackets of the per-binary array
+                "$OUT/tm_bench" | sed '1d;$d'
+            done
+        done
+    done
+done
+echo "]"
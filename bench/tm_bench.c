@@ -0,0 +1,144 @@
+/*
+ * Host benchmark of the scheduler engine. The tick is simulated by calling
+ * tmTick directly, the results are printed as a JSON array.
+ *
+ * The capacity and the engine are compile-time options, so the binary is
+ * built once per configuration, see run_bench.sh:
+ *  cc -O2 -I../taskman -DMAX_TASKS=64 -DTM_ENGINE=TM_ENGINE_WHEEL \
+ *      tm_bench.c ../taskman/taskman.c -o tm_bench
+ */
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <time.h>
+#include "taskman.h"
+
+// Number of simulated ticks per measurement
+#ifndef BENCH_TICKS
+#define BENCH_TICKS 20000
+#endif
+
+// Period of the tasks that must not become ready during a run
+#define IDLE_PERIOD 0x40000000UL
+
+static volatile uint32_t dispatched;
+
+static void sBenchTask(void) {
+    dispatched++;
+}
+
+#if MAX_TIMERS
+/*
+ * Timers are found by their callback, so every timer needs its own one
+ */
+#define CB(n) static void sTimerCb##n(void) { dispatched++; }
+#define CB4(n) CB(n##0) CB(n##1) CB(n##2) CB(n##3)
+#define CB16(n) CB4(n##0) CB4(n##1) CB4(n##2) CB4(n##3)
+#define CB64(n) CB16(n##0) CB16(n##1) CB16(n##2) CB16(n##3)
+CB64(0) CB64(1) CB64(2) CB64(3)
+#define CBREF(n) sTimerCb##n,
+#define CBREF4(n) CBREF(n##0) CBREF(n##1) CBREF(n##2) CBREF(n##3)
+#define CBREF16(n) CBREF4(n##0) CBREF4(n##1) CBREF4(n##2) CBREF4(n##3)
+#define CBREF64(n) CBREF16(n##0) CBREF16(n##1) CBREF16(n##2) CBREF16(n##3)
+#if MAX_TIMERS > 256
+#error "tm_bench has callbacks for 256 timers"
+#endif
+static void (*const timerCb[256])(void) = {
+    CBREF64(0) CBREF64(1) CBREF64(2) CBREF64(3)
+};
+#endif // MAX_TIMERS
+
+static const char* sEngineName(void) {
+#if TM_ENGINE == TM_ENGINE_WHEEL
+    return "wheel";
+#elif TM_ENGINE == TM_ENGINE_HEAP
+    return "heap";
+#else
+    return "countdown";
+#endif
+}
+
+static uint64_t sNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Cost of the clock reading itself, subtracted from every measured call
+ */
+static uint64_t sClockOverhead(void) {
+    uint64_t total = 0;
+    for (int i = 0; i < BENCH_TICKS; i++) {
+        uint64_t t0 = sNow();
+        total += sNow() - t0;
+    }
+    return total / BENCH_TICKS;
+}
+
+static bool first = true;
+
+/*
+ * One measurement: `tasks` tasks of which `ready_pct` percent start on
+ * every tick, `timers` one-shot timers that never expire during the run
+ */
+static void sRun(uint16_t tasks, uint16_t timers, uint8_t ready_pct, uint64_t overhead) {
+    tmTaskHandle_t handle[MAX_TASKS];
+    uint16_t ready = (uint32_t)tasks * ready_pct / 100;
+    uint64_t tickNs = 0, updateNs = 0;
+    uint32_t runs;
+
+    for (uint16_t i = 0; i < tasks; i++) {
+        handle[i] = tmTaskCreate(sBenchTask, i < ready ? 1 : IDLE_PERIOD);
+        if (handle[i] == TM_INVALID_HANDLE) return;
+    }
+#if MAX_TIMERS
+    for (uint16_t i = 0; i < timers; i++) {
+        if (tmTimerStartOnce(IDLE_PERIOD, timerCb[i]) != 0) return;
+    }
+#endif
+    dispatched = 0;
+
+    for (uint32_t n = 0; n < BENCH_TICKS; n++) {
+        uint64_t t0 = sNow();
+        tmTick();
+        uint64_t t1 = sNow();
+        tmUpdate();
+        uint64_t t2 = sNow();
+        tickNs += t1 - t0;
+        updateNs += t2 - t1;
+    }
+    runs = dispatched;
+
+    for (uint16_t i = 0; i < tasks; i++) tmTaskRemove(handle[i]);
+#if MAX_TIMERS
+    for (uint16_t i = 0; i < timers; i++) tmTimerDelete(timerCb[i]);
+#endif
+
+    tickNs = tickNs > overhead * BENCH_TICKS ? tickNs - overhead * BENCH_TICKS : 0;
+    updateNs = updateNs > overhead * BENCH_TICKS ? updateNs - overhead * BENCH_TICKS : 0;
+    printf("%s\n  {\"engine\": \"%s\", \"ready_bitmap\": %d, \"max_tasks\": %d, \"max_timers\": %d, "
+           "\"tasks\": %u, \"timers\": %u, \"ready_pct\": %u, \"ticks\": %u, \"dispatches\": %u, "
+           "\"ns_per_tick\": %.1f, \"ns_per_update\": %.1f, \"ns_per_dispatch\": %.1f}",
+           first ? "" : ",", sEngineName(), TM_READY_BITMAP, MAX_TASKS, MAX_TIMERS,
+           tasks, timers, ready_pct, BENCH_TICKS, runs,
+           (double)tickNs / BENCH_TICKS, (double)updateNs / BENCH_TICKS,
+           runs ? (double)updateNs / runs : 0.0);
+    first = false;
+}
+
+int main(void) {
+    static const uint8_t readyPct[] = {0, 10, 50, 100};
+    uint16_t timerCounts[] = {0, MAX_TIMERS};
+    uint64_t overhead = sClockOverhead();
+
+    printf("[");
+    for (unsigned t = 0; t < sizeof(timerCounts) / sizeof(timerCounts[0]); t++) {
+        if (t && timerCounts[t] == timerCounts[t - 1]) continue;
+        for (unsigned r = 0; r < sizeof(readyPct); r++) {
+            sRun(MAX_TASKS, timerCounts[t], readyPct[r], overhead);
+        }
+    }
+    printf("\n]\n");
+    return 0;
+}
@@ -1,98 +1,1658 @@
+// clock_gettime for the task statistics, TM_TASK_STATS is then set on the
+// command line because the define must come before any system header
+#if !defined(_POSIX_C_SOURCE) && (defined(__unix__) || defined(__APPLE__)) && \
+    defined(TM_TASK_STATS) && TM_TASK_STATS
+#define _POSIX_C_SOURCE 200112L
+#endif
+
 #include "taskman.h"
+#include "string.h"
+
+#if TM_SIM
+#include "taskman_sim.h"
+#endif
+
+#if TM_TASK_STATS && !defined(TM_STATS_COUNTER)
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__) || defined(__ARM_ARCH_8M_MAIN__)
+#define DEMCR       (*(volatile uint32_t*)0xE000EDFC)
+#define DWT_CTRL    (*(volatile uint32_t*)0xE0001000)
+#define DWT_CYCCNT  (*(volatile uint32_t*)0xE0001004)
+#define TM_STATS_COUNTER() DWT_CYCCNT
+// Enabling the trace unit and the cycle counter
+#define STATS_COUNTER_INIT() do { DEMCR |= 1UL << 24; DWT_CTRL |= 1UL; } while (0)
+#elif TM_STATS_RDTSC && (defined(__x86_64__) || defined(__i386__))
+#define TM_STATS_COUNTER() ((uint32_t)__builtin_ia32_rdtsc())
+#elif defined(__unix__) || defined(__APPLE__)
+#include <time.h>
+#ifndef CLOCK_MONOTONIC
+#error "TM_TASK_STATS needs clock_gettime, set it on the command line or define _POSIX_C_SOURCE"
+#endif
+static uint32_t sStatsClock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+#define TM_STATS_COUNTER() sStatsClock()
+#else
+#error "TM_TASK_STATS needs TM_STATS_COUNTER() for this target"
+#endif
+#endif // TM_TASK_STATS
+
+#if TM_STATIC_TASKS
+// The wheel, the heap and the staggered phases are set up before main by
+// sStaticTasksInit, the plain countdowns are ready in the initializer
+#define STATIC_TASKS_ARM (TM_ENGINE != TM_ENGINE_COUNTDOWN || TM_STAGGER)
+#if STATIC_TASKS_ARM
+#define TASK_INIT(func, period_ms, prio) { .gen = 1 },
+#else
+#define TASK_INIT(func, period_ms, prio) \
+    { .period = TM_MS_TO_TICKS(period_ms), .delay = TM_MS_TO_TICKS(period_ms), .gen = 1 },
+#endif
+#define TASK_CONST(func, period_ms, prio) { func, TM_MS_TO_TICKS(period_ms), prio },
+
+// The constant part of the tasks, placed in flash
+static const TaskConst_s taskConst[MAX_TASKS] = { TM_TASK_LIST(TASK_CONST) };
+
+// The default scheduler, its tasks are ready at startup
+tmScheduler_t tmSchedulerDefault = { .tasks = { TM_TASK_LIST(TASK_INIT) } };
+
+#define TASK_FUNC(s, i) (taskConst[i].taskFunc)
+#define TASK_PRIO(s, i) (taskConst[i].priority)
+#else
+// The default scheduler, used by the functions without a context
+tmScheduler_t tmSchedulerDefault;
+
+#define TASK_FUNC(s, i) (s->tasks[i].taskFunc)
+#define TASK_PRIO(s, i) (s->tasks[i].priority)
+#endif // TM_STATIC_TASKS
+
+/*
+ * Advancing the time, called only from the tick
+ */
+static inline void sTimeAdvance(tmScheduler_t* s, uint32_t ticks) {
+#if TM_TIME64
+    uint32_t low = s->tickCount + ticks;
+    if (low < s->tickCount) {
+        // the carry is announced before the low word wraps, so a reader that
+        // interrupts the update can tell which high word goes with the low one
+        uint32_t high = s->tickCountHigh + 1;
+        __atomic_store_n(&s->tickCountCarry, high, __ATOMIC_RELEASE);
+        __atomic_store_n(&s->tickCount, low, __ATOMIC_RELEASE);
+        __atomic_store_n(&s->tickCountHigh, high, __ATOMIC_RELEASE);
+    } else {
+        __atomic_store_n(&s->tickCount, low, __ATOMIC_RELEASE);
+    }
+#else
+    s->tickCount += ticks;
+#endif
+}
+
+/*
+ * The current time in ticks, safe to read from any context. The reader
+ * never waits for the tick, so it may also interrupt the tick itself.
+ */
+static inline tmTime_t sNow(tmScheduler_t* s) {
+#if TM_TIME64
+    uint32_t high, low;
+    do {
+        high = __atomic_load_n(&s->tickCountHigh, __ATOMIC_ACQUIRE);
+        low = __atomic_load_n(&s->tickCount, __ATOMIC_ACQUIRE);
+        // a carry completed in between, the time is read again
+    } while (high != __atomic_load_n(&s->tickCountHigh, __ATOMIC_ACQUIRE));
+    // the reader interrupted a carry after the low word wrapped; the ticks
+    // of one advance stay below 2^31, so the wrapped low word is small
+    if (__atomic_load_n(&s->tickCountCarry, __ATOMIC_ACQUIRE) != high && low < 0x80000000UL) high++;
+    return (uint64_t)high << 32 | low;
+#else
+    return s->tickCount;
+#endif
+}
+
+#if MAX_TIMERS
+#if TM_TIME64
+/*
+ * The 64-bit start stamp takes two stores on a 32-bit MCU. It is written
+ * only while the timer is inactive and published by setting the flag, the
+ * tick reads it only after it has seen the flag.
+ */
+#define TIMER_PUBLISH(t)    __atomic_store_n(&(t)->active, 1, __ATOMIC_RELEASE)
+#define TIMER_ACTIVE(t)     __atomic_load_n(&(t)->active, __ATOMIC_ACQUIRE)
+
+/*
+ * The start stamp read outside the tick, which moves it on every reload of
+ * a periodic timer. A torn read differs from the next one.
+ */
+static inline tmTime_t sTimerStamp(const OneShotTimer_s* t) {
+    tmTime_t stamp;
+    do {
+        stamp = *(const volatile tmTime_t*)&t->start_time;
+    } while (stamp != *(const volatile tmTime_t*)&t->start_time);
+    return stamp;
+}
+#else
+#define TIMER_PUBLISH(t)    ((t)->active = 1)
+#define TIMER_ACTIVE(t)     ((t)->active)
+#define sTimerStamp(t)      ((t)->start_time)
+#endif // TM_TIME64
+#endif // MAX_TIMERS
+
+#if MAX_TIMERS && TM_TIMER_DEFERRED
+#define TIMER_QUEUE_MASK (TM_TIMER_QUEUE_SIZE - 1)
+
+#if (TM_TIMER_QUEUE_SIZE & TIMER_QUEUE_MASK) != 0 || TM_TIMER_QUEUE_SIZE > 128
+#error "TM_TIMER_QUEUE_SIZE must be a power of two up to 128"
+#endif
+
+#if MAX_TIMERS > 256
+#error "TM_TIMER_DEFERRED queues the timer index in 8 bits, MAX_TIMERS must be up to 256"
+#endif
+
+/*
+ * Posting the timer from the tick, returns false if the queue is full
+ */
+static bool sTimerPost(tmScheduler_t* s, int i) {
+    uint8_t head = s->timerQueueHead;
+    if ((uint8_t)(head - __atomic_load_n(&s->timerQueueTail, __ATOMIC_ACQUIRE)) == TM_TIMER_QUEUE_SIZE) {
+        return false;
+    }
+    s->timerQueue[head & TIMER_QUEUE_MASK] = (uint16_t)(s->timers[i].gen << 8 | i);
+    __atomic_store_n(&s->timerQueueHead, (uint8_t)(head + 1), __ATOMIC_RELEASE);
+    return true;
+}
+
+/*
+ * Starting the posted callbacks from tmUpdate, returns the number of them.
+ * A timer deleted after it was posted has another generation, its start
+ * is dropped.
+ */
+static uint8_t sTimerDrain(tmScheduler_t* s) {
+    uint8_t count = 0;
+    uint8_t tail = s->timerQueueTail;
+    while (tail != __atomic_load_n(&s->timerQueueHead, __ATOMIC_ACQUIRE)) {
+        uint16_t posted = s->timerQueue[tail & TIMER_QUEUE_MASK];
+        OneShotTimer_s* timer = &s->timers[posted & 0xFF];
+        void (*callback)(void) = 0;
+        tail++;
+        __atomic_store_n(&s->timerQueueTail, tail, __ATOMIC_RELEASE);
+        TM_ENTER_CRITICAL();
+        if (timer->gen == (posted >> 8)) callback = timer->callback;
+        TM_EXIT_CRITICAL();
+        if (!callback) continue;
+        callback();
+        count++;
+    }
+    return count;
+}
+#endif // TM_TIMER_DEFERRED
+
+#if TM_TIMER_NODES
+/*
+ * The comparison survives the tick counter overflow while the expiry
+ * times differ by less than 2^31 ticks
+ */
+static inline bool sNodeBefore(const TimerNode_s* a, const TimerNode_s* b) {
+    return (int32_t)(a->expire - b->expire) < 0;
+}
+
+/*
+ * Linking two heaps, the later root becomes the first child of the other.
+ * The roots have no siblings.
+ */
+static TimerNode_s* sNodeMeld(TimerNode_s* a, TimerNode_s* b) {
+    if (!a) return b;
+    if (!b) return a;
+    if (sNodeBefore(b, a)) {
+        TimerNode_s* t = a;
+        a = b;
+        b = t;
+    }
+    b->prev = a;
+    b->next = a->child;
+    if (a->child) a->child->prev = b;
+    a->child = b;
+    return a;
+}
+
+/*
+ * Two-pass merge of a sibling list into one heap: the siblings are melded
+ * in pairs from the left, then the pairs are melded from the right
+ */
+static TimerNode_s* sNodeMergePairs(TimerNode_s* first) {
+    TimerNode_s* pairs = 0;     // the melded pairs, linked backwards by next
+    TimerNode_s* root = 0;
+    while (first) {
+        TimerNode_s* a = first;
+        TimerNode_s* b = a->next;
+        first = b ? b->next : 0;
+        a->next = a->prev = 0;
+        if (b) {
+            b->next = b->prev = 0;
+            a = sNodeMeld(a, b);
+        }
+        a->next = pairs;
+        pairs = a;
+    }
+    while (pairs) {
+        TimerNode_s* a = pairs;
+        pairs = a->next;
+        a->next = 0;
+        root = sNodeMeld(root, a);
+    }
+    return root;
+}
+
+/*
+ * Taking the timer out of the heap, its children are merged back
+ */
+static void sNodeRemove(tmScheduler_t* s, TimerNode_s* t) {
+    TimerNode_s* sub = sNodeMergePairs(t->child);
+    if (t == s->timerRoot) {
+        s->timerRoot = sub;
+    } else {
+        if (t->prev->child == t) {
+            t->prev->child = t->next;
+        } else {
+            t->prev->next = t->next;
+        }
+        if (t->next) t->next->prev = t->prev;
+        s->timerRoot = sNodeMeld(s->timerRoot, sub);
+    }
+    t->child = t->next = t->prev = 0;
+    t->active = 0;
+}
+
+static void sNodeInsert(tmScheduler_t* s, TimerNode_s* t, uint32_t expire) {
+    t->expire = expire;
+    t->deadline = expire;
+    t->active = 1;
+    s->timerRoot = sNodeMeld(s->timerRoot, t);
+}
+
+/*
+ * The expiry of the timer, at least one tick from now, so a timer
+ * restarted by its callback waits for the next pass
+ */
+static inline uint32_t sNodeExpire(tmScheduler_t* s, uint32_t delay) {
+    return s->tickCount + (delay ? delay : 1);
+}
+
+static void sNodeStart(tmScheduler_t* s, TimerNode_s* t, uint32_t delay) {
+    if (t->active) sNodeRemove(s, t);
+    sNodeInsert(s, t, sNodeExpire(s, delay));
+}
+
+/*
+ * A later deadline of an active timer is only stored, the timer stays at
+ * its old place in the heap and is moved when that one comes due. Only an
+ * earlier deadline (or an inactive timer) changes the heap at once.
+ */
+static void sNodeRestart(tmScheduler_t* s, TimerNode_s* t, uint32_t delay) {
+    uint32_t deadline = sNodeExpire(s, delay);
+    if (t->active && (int32_t)(deadline - t->expire) >= 0) {
+        t->deadline = deadline;
+        return;
+    }
+    if (t->active) sNodeRemove(s, t);
+    sNodeInsert(s, t, deadline);
+}
+
+/*
+ * Starting the expired timers from tmUpdate, returns the number of them
+ */
+static uint32_t sNodesRun(tmScheduler_t* s) {
+    uint32_t now = s->tickCount;
+    uint32_t count = 0;
+    TimerNode_s* t;
+    while ((t = s->timerRoot) != 0 && (int32_t)(now - t->expire) >= 0) {
+        sNodeRemove(s, t);
+        if ((int32_t)(t->deadline - t->expire) > 0) {
+            // restarted lazily, moved to its real deadline
+            sNodeInsert(s, t, t->deadline);
+            continue;
+        }
+        t->callback(t->arg);
+        count++;
+    }
+    return count;
+}
+
+void tmTimerNodeInit(TimerNode_s* t, void (*callback)(void* arg), void* arg) {
+    t->child = t->next = t->prev = 0;
+    t->active = 0;
+    t->callback = callback;
+    t->arg = arg;
+}
+
+void tmTimerNodeStart_r(tmScheduler_t* s, TimerNode_s* t, uint32_t delay_ms) {
+    sNodeStart(s, t, TM_MS_TO_TICKS(delay_ms));
+}
+
+void tmTimerNodeStart_us_r(tmScheduler_t* s, TimerNode_s* t, uint32_t delay_us) {
+    sNodeStart(s, t, TM_US_TO_TICKS(delay_us));
+}
+
+void tmTimerNodeRestart_r(tmScheduler_t* s, TimerNode_s* t, uint32_t delay_ms) {
+    sNodeRestart(s, t, TM_MS_TO_TICKS(delay_ms));
+}
+
+void tmTimerNodeRestart_us_r(tmScheduler_t* s, TimerNode_s* t, uint32_t delay_us) {
+    sNodeRestart(s, t, TM_US_TO_TICKS(delay_us));
+}
+
+bool tmTimerNodeCancel_r(tmScheduler_t* s, TimerNode_s* t) {
+    if (!t->active) return false;
+    sNodeRemove(s, t);
+    return true;
+}
+
+bool tmTimerNodeActive(const TimerNode_s* t) {
+    return t->active;
+}
+#endif // TM_TIMER_NODES
+
+#if TM_ENGINE != TM_ENGINE_HEAP || TM_PRIORITIES
+// The pending activations of a task saturate at this value
+#define PENDING_MAX 255
+
+#if TM_READY_BITMAP
+#define READY_WORDS ((MAX_TASKS + 31) / 32)
+#endif
+
+#if TM_EDF
+// The relative deadline of the task in ticks
+static inline uint32_t sTaskDeadline(tmScheduler_t* s, uint8_t i) {
+    return s->tasks[i].deadline ? s->tasks[i].deadline : s->tasks[i].period;
+}
+#endif
+
+/*
+ * Counting the releases of the task, the latest one was at the tick at.
+ * The releases that find the previous activation not started yet are
+ * overruns. Only the tick adds activations and tmUpdate only takes them,
+ * so the saturation check cannot overflow.
+ */
+static inline void sRelease(tmScheduler_t* s, uint8_t i, uint32_t count, uint32_t at) {
+    uint8_t pending = s->tasks[i].pending;
+#if TM_EDF
+    // the pending activation is run once for the latest release
+    s->tasks[i].absDeadline = at + sTaskDeadline(s, i);
+#else
+    (void)at;
+#endif
+    s->tasks[i].overruns += pending ? count : count - 1;
+    if (count > (uint32_t)(PENDING_MAX - pending)) count = PENDING_MAX - pending;
+    if (count) TM_ATOMIC_ADD(&s->tasks[i].pending, (uint8_t)count);
+#if TM_READY_BITMAP
+    TM_ATOMIC_OR(&s->readyMask[i / 32], 1UL << (i % 32));
+#endif
+}
+
+static inline void sClearReady(tmScheduler_t* s, uint8_t i) {
+#if TM_READY_BITMAP
+    TM_ATOMIC_AND(&s->readyMask[i / 32], ~(1UL << (i % 32)));
+#endif
+    TM_ATOMIC_EXCHANGE(&s->tasks[i].pending, 0);
+}
+
+static inline bool sIsReady(tmScheduler_t* s, uint8_t i) {
+#if TM_READY_BITMAP
+    return (s->readyMask[i / 32] >> (i % 32)) & 1;
+#else
+    return s->tasks[i].pending != 0;
+#endif
+}
+#endif // TM_ENGINE != TM_ENGINE_HEAP || TM_PRIORITIES
+
+#if TM_EVENTS && TM_ENGINE == TM_ENGINE_HEAP && !TM_PRIORITIES
+#define EVENT_WORDS ((MAX_TASKS + 31) / 32)
+#endif
+
+#if TM_ENGINE == TM_ENGINE_WHEEL
+#define WHEEL_MASK (TM_WHEEL_SIZE - 1)
+
+#if (TM_WHEEL_SIZE & WHEEL_MASK) != 0
+#error "TM_WHEEL_SIZE must be a power of two"
+#endif
+#endif // TM_ENGINE_WHEEL
+
+
+/*
+ * Custom idle function
+ * It can be redefined in the right place.
+ */
+__attribute__((weak)) void sIdleTask(void) {
+    ///__WFI(); 														//Switching to sleep until the next SysTick interrupt (optimization)
+}
+
+#if TM_TICKLESS
+/*
+ * Custom tickless idle function
+ * It can be redefined in the right place: program a one-shot timer for the
+ * given number of ticks (TM_TICKS_INFINITE - nothing is scheduled), sleep,
+ * and report the really passed ticks with tmTickAdvance.
+ */
+__attribute__((weak)) void sIdleTickless(uint32_t ticks) {
+    (void)ticks;
+    sIdleTask();
+}
+#endif // TM_TICKLESS
+
+/*
+ * Custom idle functions of a scheduler instance
+ * They get the scheduler that has nothing to do, so a tickless instance
+ * can advance its own clock with tmTickAdvance_r. By default the default
+ * scheduler calls the hooks above, the other instances only sIdleTask.
+ */
+__attribute__((weak)) void sIdleTask_r(tmScheduler_t* s) {
+    (void)s;
+    sIdleTask();
+}
+
+#if TM_TICKLESS
+__attribute__((weak)) void sIdleTickless_r(tmScheduler_t* s, uint32_t ticks) {
+    if (s == &tmSchedulerDefault) sIdleTickless(ticks);
+    else sIdleTask_r(s);
+}
+#endif // TM_TICKLESS
+
+uint32_t get_ticks_r(tmScheduler_t* s) {
+    return s->tickCount;
+}
+
+uint32_t get_millis_r(tmScheduler_t* s) {
+#if TM_TICK_US == 1000
+    return s->tickCount;
+#else
+    return (uint32_t)((uint64_t)sNow(s) * TM_TICK_US / 1000);
+#endif
+};
+
+uint32_t get_micros_r(tmScheduler_t* s) {
+    // the product wraps together with the ticks, the differences stay valid
+    return (uint32_t)sNow(s) * TM_TICK_US;
+}
+
+#if TM_TIME64
+uint64_t get_millis64_r(tmScheduler_t* s) {
+#if TM_TICK_US == 1000
+    return sNow(s);
+#else
+    return sNow(s) * TM_TICK_US / 1000;
+#endif
+}
+#endif // TM_TIME64
+
+#if TM_ENGINE == TM_ENGINE_WHEEL
+/*
+ * Putting the task into the bucket of its expiry tick
+ */
+static void sWheelInsert(tmScheduler_t* s, uint8_t i) {
+    uint8_t* head = &s->wheel[s->tasks[i].expire & WHEEL_MASK];
+    s->tasks[i].next = *head;
+    *head = i + 1;
+}
+
+/*
+ * Removing the task from its bucket, if it is there
+ */
+static void sWheelRemove(tmScheduler_t* s, uint8_t i) {
+    uint8_t* link = &s->wheel[s->tasks[i].expire & WHEEL_MASK];
+    while (*link) {
+        if (*link == i + 1) {
+            *link = s->tasks[i].next;
+            return;
+        }
+        link = &s->tasks[*link - 1].next;
+    }
+}
+
+/*
+ * Only the buckets of the coming ticks are walked, at most the whole wheel
+ * once. Tasks of the later wheel rounds stay in place, the due ones are
+ * marked and moved to the bucket of their next start.
+ */
+static void sWheelAdvance(tmScheduler_t* s, uint32_t ticks) {
+    uint32_t from = s->tickCount;
+    uint32_t target = from + ticks;
+    uint32_t buckets = ticks < TM_WHEEL_SIZE ? ticks : TM_WHEEL_SIZE;
+    for (uint32_t b = 1; b <= buckets; b++) {
+        uint8_t* link = &s->wheel[(from + b) & WHEEL_MASK];
+        while (*link) {
+            uint8_t i = *link - 1;
+            if (s->tasks[i].expire - from - 1 < ticks) {
+                uint32_t count = 1;
+                *link = s->tasks[i].next;
+                s->tasks[i].expire += s->tasks[i].period;
+                if ((int32_t)(target - s->tasks[i].expire) >= 0) {
+                    // several periods passed at once
+                    uint32_t missed = (target - s->tasks[i].expire) / s->tasks[i].period + 1;
+                    s->tasks[i].expire += missed * s->tasks[i].period;
+                    count += missed;
+                }
+                sRelease(s, i, count, s->tasks[i].expire - s->tasks[i].period);
+                sWheelInsert(s, i);
+            } else {
+                link = &s->tasks[i].next;
+            }
+        }
+    }
+}
+#endif // TM_ENGINE_WHEEL
+
+#if TM_ENGINE == TM_ENGINE_HEAP
+/*
+ * The comparison survives the tick counter overflow while the start times
+ * differ by less than 2^31 ms
+ */
+static bool sHeapBefore(tmScheduler_t* s, uint8_t a, uint8_t b) {
+    return (int32_t)(s->tasks[a].release - s->tasks[b].release) < 0;
+}
+
+static void sHeapSet(tmScheduler_t* s, uint8_t pos, uint8_t i) {
+    s->heap[pos] = i;
+    s->tasks[i].heapPos = pos + 1;
+}
+
+static void sHeapUp(tmScheduler_t* s, uint8_t pos) {
+    uint8_t i;
+    // the positions stay below MAX_TASKS, the check is for the compiler
+    if (pos >= MAX_TASKS) return;
+    i = s->heap[pos];
+    while (pos > 0) {
+        uint8_t parent = (pos - 1) / 2;
+        if (!sHeapBefore(s, i, s->heap[parent])) break;
+        sHeapSet(s, pos, s->heap[parent]);
+        pos = parent;
+    }
+    sHeapSet(s, pos, i);
+}
+
+static void sHeapDown(tmScheduler_t* s, uint8_t pos) {
+    uint8_t i = s->heap[pos];
+    for ( ; ; ) {
+        uint16_t child = 2 * pos + 1;
+        // MAX_TASKS bounds the children for the compiler in small configurations
+        if (child >= s->heapSize || child >= MAX_TASKS) break;
+        if (child + 1 < s->heapSize && child + 1 < MAX_TASKS && sHeapBefore(s, s->heap[child + 1], s->heap[child])) child++;
+        if (!sHeapBefore(s, s->heap[child], i)) break;
+        sHeapSet(s, pos, s->heap[child]);
+        pos = child;
+    }
+    sHeapSet(s, pos, i);
+}
+
+static void sHeapPush(tmScheduler_t* s, uint8_t i) {
+    s->heap[s->heapSize] = i;
+    sHeapUp(s, s->heapSize++);
+}
+
+/*
+ * Removing the task from an arbitrary heap position, if it is there
+ */
+static void sHeapRemove(tmScheduler_t* s, uint8_t i) {
+    uint8_t pos;
+    if (!s->tasks[i].heapPos) return;
+    pos = s->tasks[i].heapPos - 1;
+    s->tasks[i].heapPos = 0;
+    if (--s->heapSize == pos) return;
+    s->heap[pos] = s->heap[s->heapSize];
+    sHeapUp(s, pos);
+    sHeapDown(s, s->tasks[s->heap[pos]].heapPos - 1);
+}
+
+/*
+ * Taking the due task from the heap top and moving it to its next start,
+ * the first period boundary after now. The number of the period boundaries
+ * passed is stored in count. Returns -1 if nothing is due.
+ */
+static int16_t sHeapTakeDue(tmScheduler_t* s, uint32_t now, uint32_t* count) {
+    uint8_t i;
+    uint32_t late;
+    if (!s->heapSize || (int32_t)(now - s->tasks[s->heap[0]].release) < 0) return -1;
+    i = s->heap[0];
+    late = now - s->tasks[i].release;
+    *count = late / s->tasks[i].period + 1;
+    s->tasks[i].release += *count * s->tasks[i].period;
+    sHeapDown(s, 0);
+    return i;
+}
+#endif // TM_ENGINE_HEAP
+
+// The phase of the tasks that are added without one. A period change keeps
+// the full-period re-arm, so retuning a period stays O(1).
+#if TM_STAGGER
+#define PHASE_DEFAULT TM_PHASE_AUTO
+#else
+#define PHASE_DEFAULT 0
+#endif
+
+// The number of phases tried by the automatic staggering at most
+#define STAGGER_CANDIDATES 64
+
+static uint32_t sGcd(uint32_t a, uint32_t b) {
+    while (b) {
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+/*
+ * The absolute tick of the next start of the task
+ */
+static uint32_t sTaskNextStart(tmScheduler_t* s, uint8_t i) {
+#if TM_ENGINE == TM_ENGINE_WHEEL
+    return s->tasks[i].expire;
+#elif TM_ENGINE == TM_ENGINE_HEAP
+    return s->tasks[i].release;
+#else
+    return s->tickCount + s->tasks[i].delay;
+#endif
+}
+
+/*
+ * Choosing the first start of task i with the given period so that its
+ * starts are as far as possible from the starts of the other tasks.
+ * The starts of two tasks meet modulo the gcd of their periods, so every
+ * candidate phase is scored by the smallest of these distances and the
+ * best one is taken. The scores repeat with the lcm of the gcds, which
+ * divides the period, only this span is searched. The gcd of every other
+ * task is computed once and its distances to the candidates follow by
+ * adding the step, so a call costs O(MAX_TASKS) gcds and no division per
+ * candidate; the candidates that meet a start drop out.
+ */
+static uint32_t sTaskStagger(tmScheduler_t* s, uint8_t i, uint32_t period) {
+    uint32_t now = s->tickCount, span = 1, step, best = 0, bestDist = 0;
+    uint32_t dist[STAGGER_CANDIDATES];
+    uint64_t alive;     // the candidates not yet meeting the starts of another task
+    uint32_t count;
+    for (int j = 0; j < MAX_TASKS; j++) {
+        if (j == i || !TASK_FUNC(s, j) || !s->tasks[j].period) continue;
+        uint32_t g = sGcd(period, s->tasks[j].period);
+        span = span / sGcd(span, g) * g;
+    }
+    step = (span + STAGGER_CANDIDATES - 1) / STAGGER_CANDIDATES;
+    count = (span + step - 1) / step;
+    for (uint32_t k = 0; k < count; k++) dist[k] = UINT32_MAX;
+    alive = count < 64 ? (1ULL << count) - 1 : ~0ULL;
+    // once every candidate meets some start the first one is taken
+    for (int j = 0; j < MAX_TASKS && alive; j++) {
+        if (j == i || !TASK_FUNC(s, j) || !s->tasks[j].period) continue;
+        uint32_t g = sGcd(period, s->tasks[j].period);
+        uint32_t stepMod = step % g;
+        // the offset of the first candidate from the starts of task j, modulo g
+        int32_t diff = (int32_t)(now - sTaskNextStart(s, j)) % (int32_t)g;
+        uint32_t x = diff < 0 ? (uint32_t)(diff + (int32_t)g) : (uint32_t)diff;
+        for (uint32_t k = 0; k < count && (alive >> k) != 0; k++) {
+            uint32_t d = g - x < x ? g - x : x;
+            if (d < dist[k]) {
+                dist[k] = d;
+                if (!d) alive &= ~(1ULL << k);
+            }
+            x += stepMod;
+            if (x >= g) x -= g;
+        }
+    }
+    for (uint32_t k = 0; k < count; k++) {
+        if (dist[k] > bestDist) {
+            bestDist = dist[k];
+            best = k * step;
+        }
+    }
+    return best;
+}
+
+/*
+ * (Re)starting the countdown of the task with a new period, the first
+ * start comes after phase ticks (modulo the period, 0 - a full period)
+ */
+static void sTaskArm(tmScheduler_t* s, uint8_t i, uint32_t period, uint32_t phase) {
+    if (period) {
+        if (phase == TM_PHASE_AUTO) phase = sTaskStagger(s, i, period);
+        phase %= period;
+        if (!phase) phase = period;
+    }
+    TM_ENTER_CRITICAL();
+#if TM_ENGINE == TM_ENGINE_WHEEL
+    sWheelRemove(s, i);
+    s->tasks[i].period = period;
+    s->tasks[i].expire = s->tickCount + phase;
+    sClearReady(s, i);
+    if (period) sWheelInsert(s, i);
+#elif TM_ENGINE == TM_ENGINE_HEAP
+    sHeapRemove(s, i);
+    s->tasks[i].period = period;
+    s->tasks[i].release = s->tickCount + phase;
+#if TM_PRIORITIES
+    sClearReady(s, i);
+#endif
+    if (period) sHeapPush(s, i);
+#else
+    s->tasks[i].period = period;
+    s->tasks[i].delay = period ? phase : 0;
+    sClearReady(s, i);
+#endif
+    TM_EXIT_CRITICAL();
+}
+
+/*
+ * Restarting the period of a late task from now, the phase of its starts
+ * moves (TM_CATCHUP_ONCE)
+ */
+static void sTaskRephase(tmScheduler_t* s, uint8_t i) {
+    TM_ENTER_CRITICAL();
+#if TM_ENGINE == TM_ENGINE_WHEEL
+    if (s->tasks[i].period) {
+        sWheelRemove(s, i);
+        s->tasks[i].expire = s->tickCount + s->tasks[i].period;
+        sWheelInsert(s, i);
+    }
+#elif TM_ENGINE == TM_ENGINE_HEAP
+    if (s->tasks[i].heapPos) {
+        sHeapRemove(s, i);
+        s->tasks[i].release = s->tickCount + s->tasks[i].period;
+        sHeapPush(s, i);
+    }
+#else
+    if (s->tasks[i].delay) s->tasks[i].delay = s->tasks[i].period;
+#endif
+    TM_EXIT_CRITICAL();
+}
+
+#if TM_ENGINE != TM_ENGINE_HEAP || TM_PRIORITIES
+/*
+ * Taking the pending activations that are started now, according to the
+ * catch-up policy of the task. Returns false if nothing was pending.
+ */
+static bool sTakeActivation(tmScheduler_t* s, uint8_t i) {
+    uint8_t taken;
+#if TM_READY_BITMAP
+    TM_ATOMIC_AND(&s->readyMask[i / 32], ~(1UL << (i % 32)));
+#endif
+    if (s->tasks[i].catchup == TM_CATCHUP_BURST) {
+        // one start per activation, the rest stay pending
+        if (!s->tasks[i].pending) return false;
+        taken = TM_ATOMIC_SUB(&s->tasks[i].pending, 1);
+#if TM_READY_BITMAP
+        if (taken > 1) TM_ATOMIC_OR(&s->readyMask[i / 32], 1UL << (i % 32));
+#endif
+        return true;
+    }
+    taken = TM_ATOMIC_EXCHANGE(&s->tasks[i].pending, 0);
+    if (!taken) return false;
+    if (taken > 1 && s->tasks[i].catchup == TM_CATCHUP_ONCE) sTaskRephase(s, i);
+    return true;
+}
+#endif // TM_ENGINE != TM_ENGINE_HEAP || TM_PRIORITIES
+
+#if TM_STATIC_TASKS && (STATIC_TASKS_ARM || defined(STATS_COUNTER_INIT))
+/*
+ * Setting up the static tasks before main, they never pass sTaskAlloc.
+ * The tasks are armed one by one, so that every task is staggered against
+ * the ones armed before it.
+ */
+__attribute__((constructor)) static void sStaticTasksInit(void) {
+#ifdef STATS_COUNTER_INIT
+    STATS_COUNTER_INIT();
+#endif
+#if STATIC_TASKS_ARM
+    for (int i = 0; i < MAX_TASKS; i++) sTaskArm(&tmSchedulerDefault, i, taskConst[i].period, PHASE_DEFAULT);
+#endif
+}
+#endif // TM_STATIC_TASKS
+
+void tmSchedulerInit(tmScheduler_t* s) {
+    memset(s, 0, sizeof(*s));
+#if TM_STATIC_TASKS
+    // the static tasks keep their slots, they are stopped until tmTaskSetPeriod_r
+    for (int i = 0; i < MAX_TASKS; i++) s->tasks[i].gen = 1;
+#endif
+#ifdef STATS_COUNTER_INIT
+    STATS_COUNTER_INIT();
+#endif
+}
+
+/*
+ * Taking a free slot for the task, the generation of the slot is changed
+ * so that the handles of its previous tasks become stale.
+ * Returns the slot or -1 if there are no free slots.
+ */
+
+static int16_t sTaskAlloc(tmScheduler_t* s, void (*func)(void), uint32_t period, uint32_t phase) {
+#if TM_STATIC_TASKS
+    // all the slots are taken by the static table
+    (void)s;
+    (void)func;
+    (void)period;
+    (void)phase;
+    return -1;
+#else
+    for (int i = 0; i < MAX_TASKS; i++) {
+        //Search for a free slot in the array
+        if (TASK_FUNC(s, i) == 0) {
+            sTaskArm(s, i, period, phase);
+#if TM_PRIORITIES
+            s->tasks[i].priority = 0;
+#endif
+#if TM_EDF
+            s->tasks[i].deadline = 0;
+            s->tasks[i].misses = 0;
+#endif
+            if (++s->tasks[i].gen == 0) s->tasks[i].gen = 1;
+            s->tasks[i].catchup = TM_CATCHUP_SKIP;
+            s->tasks[i].overruns = 0;
+#if TM_COROUTINES
+            s->tasks[i].coLine = 0;
+#endif
+#if TM_EVENTS
+            s->tasks[i].events = 0;
+#if TM_ENGINE == TM_ENGINE_HEAP && !TM_PRIORITIES
+            TM_ATOMIC_AND(&s->eventMask[i / 32], ~(1UL << (i % 32)));
+#endif
+#endif // TM_EVENTS
+#if TM_TASK_STATS
+#ifdef STATS_COUNTER_INIT
+            STATS_COUNTER_INIT();
+#endif
+            s->tasks[i].stats = (TaskStats_s){0};
+#endif // TM_TASK_STATS
+            s->tasks[i].taskFunc = func;
+            return i;
+        }
+    }
+    return -1;
+#endif // TM_STATIC_TASKS
+}
+
+static void sTaskFree(tmScheduler_t* s, uint8_t i) {
+#if TM_ENGINE == TM_ENGINE_WHEEL
+    TM_ENTER_CRITICAL();
+    sWheelRemove(s, i);
+    TM_EXIT_CRITICAL();
+#elif TM_ENGINE == TM_ENGINE_HEAP
+    sHeapRemove(s, i);
+#endif
+#if TM_STATIC_TASKS
+    // a static task only stops, it is started again by tmTaskSetPeriod
+    sTaskArm(s, i, 0, 0);
+#else
+    s->tasks[i].taskFunc = 0;
+#endif
+}
+
+/*
+ * Checking the handle, returns the slot or -1 for a stale handle
+ */
+static int16_t sTaskSlot(tmScheduler_t* s, tmTaskHandle_t handle) {
+    uint8_t i = handle & 0xFF;
+    if (i >= MAX_TASKS || !TASK_FUNC(s, i) || s->tasks[i].gen != (handle >> 8)) return -1;
+    return i;
+}
+
+int8_t tmAddTask_r(tmScheduler_t* s, void (*func)(void), uint32_t period_ms) {
+    return sTaskAlloc(s, func, TM_MS_TO_TICKS(period_ms), PHASE_DEFAULT);
+}
+
+#if TM_PRIORITIES
+int8_t tmAddTaskPrio_r(tmScheduler_t* s, void (*func)(void), uint32_t period_ms, uint8_t priority) {
+    int16_t i = sTaskAlloc(s, func, TM_MS_TO_TICKS(period_ms), PHASE_DEFAULT);
+#if !TM_STATIC_TASKS
+    if (i >= 0) s->tasks[i].priority = priority;
+#else
+    (void)priority;
+#endif
+    return i;
+}
+#endif // TM_PRIORITIES
+
+int8_t tmUpdateTask_r(tmScheduler_t* s, void (*func)(void), uint32_t period_ms) {
+    for (int i = 0; i < MAX_TASKS; i++) {
+        //Search for a free slot in the array
+        if (TASK_FUNC(s, i) == func) {
+            sTaskArm(s, i, TM_MS_TO_TICKS(period_ms), 0);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int8_t tmDeleteTask_r(tmScheduler_t* s, void (*func)(void)) {
+    for (int i = 0; i < MAX_TASKS; i++) {
+        //Search for a func slot in the array
+        if (TASK_FUNC(s, i) == func) {
+            sTaskFree(s, i);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+tmTaskHandle_t tmTaskCreate_r(tmScheduler_t* s, void (*func)(void), uint32_t period_ms) {
+    int16_t i;
+    if (!func) return TM_INVALID_HANDLE;
+    i = sTaskAlloc(s, func, TM_MS_TO_TICKS(period_ms), PHASE_DEFAULT);
+    if (i < 0) return TM_INVALID_HANDLE;
+    return (tmTaskHandle_t)(s->tasks[i].gen << 8 | i);
+}
+
+int8_t tmTaskSetPeriod_r(tmScheduler_t* s, tmTaskHandle_t handle, uint32_t period_ms) {
+    int16_t i = sTaskSlot(s, handle);
+    if (i < 0) return -1;
+    sTaskArm(s, i, TM_MS_TO_TICKS(period_ms), 0);
+    return 0;
+}
+
+tmTaskHandle_t tmTaskCreatePhase_r(tmScheduler_t* s, void (*func)(void), uint32_t period_ms, uint32_t phase_ms) {
+    int16_t i;
+    if (!func) return TM_INVALID_HANDLE;
+    if (phase_ms != TM_PHASE_AUTO) phase_ms = TM_MS_TO_TICKS(phase_ms);
+    i = sTaskAlloc(s, func, TM_MS_TO_TICKS(period_ms), phase_ms);
+    if (i < 0) return TM_INVALID_HANDLE;
+    return (tmTaskHandle_t)(s->tasks[i].gen << 8 | i);
+}
+
+int8_t tmTaskSetPhase_r(tmScheduler_t* s, tmTaskHandle_t handle, uint32_t phase_ms) {
+    int16_t i = sTaskSlot(s, handle);
+    if (i < 0) return -1;
+    if (phase_ms != TM_PHASE_AUTO) phase_ms = TM_MS_TO_TICKS(phase_ms);
+    sTaskArm(s, i, s->tasks[i].period, phase_ms);
+    return 0;
+}
+
+tmTaskHandle_t tmTaskCreate_us_r(tmScheduler_t* s, void (*func)(void), uint32_t period_us) {
+    int16_t i;
+    if (!func) return TM_INVALID_HANDLE;
+    i = sTaskAlloc(s, func, TM_US_TO_TICKS(period_us), PHASE_DEFAULT);
+    if (i < 0) return TM_INVALID_HANDLE;
+    return (tmTaskHandle_t)(s->tasks[i].gen << 8 | i);
+}
+
+int8_t tmTaskSetPeriod_us_r(tmScheduler_t* s, tmTaskHandle_t handle, uint32_t period_us) {
+    int16_t i = sTaskSlot(s, handle);
+    if (i < 0) return -1;
+    sTaskArm(s, i, TM_US_TO_TICKS(period_us), 0);
+    return 0;
+}
+
+int8_t tmTaskRemove_r(tmScheduler_t* s, tmTaskHandle_t handle) {
+    int16_t i = sTaskSlot(s, handle);
+    if (i < 0) return -1;
+    sTaskFree(s, i);
+    return 0;
+}
+
+tmTaskHandle_t tmTaskFind_r(tmScheduler_t* s, void (*func)(void)) {
+    for (int i = 0; i < MAX_TASKS; i++) {
+        if (func && TASK_FUNC(s, i) == func) return (tmTaskHandle_t)(s->tasks[i].gen << 8 | i);
+    }
+    return TM_INVALID_HANDLE;
+}
+
+int8_t tmTaskSetCatchup_r(tmScheduler_t* s, tmTaskHandle_t handle, uint8_t policy) {
+    int16_t i = sTaskSlot(s, handle);
+    if (i < 0 || policy > TM_CATCHUP_BURST) return -1;
+    s->tasks[i].catchup = policy;
+    return 0;
+}
+
+int8_t tmTaskGetOverruns_r(tmScheduler_t* s, tmTaskHandle_t handle, uint32_t* overruns) {
+    int16_t i = sTaskSlot(s, handle);
+    if (i < 0) return -1;
+    *overruns = s->tasks[i].overruns;
+    return 0;
+}
+
+#if TM_TASK_STATS
+int8_t tmTaskGetStats_r(tmScheduler_t* s, tmTaskHandle_t handle, TaskStats_s* stats) {
+    int16_t i = sTaskSlot(s, handle);
+    if (i < 0) return -1;
+    *stats = s->tasks[i].stats;
+    return 0;
+}
+
+int8_t tmTaskResetStats_r(tmScheduler_t* s, tmTaskHandle_t handle) {
+    int16_t i = sTaskSlot(s, handle);
+    if (i < 0) return -1;
+    s->tasks[i].stats = (TaskStats_s){0};
+    return 0;
+}
+#endif // TM_TASK_STATS
+
+#if TM_PRIORITIES
+int8_t tmTaskSetPriority_r(tmScheduler_t* s, tmTaskHandle_t handle, uint8_t priority) {
+    int16_t i = sTaskSlot(s, handle);
+#if TM_STATIC_TASKS
+    // the priorities of the static tasks are constant
+    (void)i;
+    (void)priority;
+    return -1;
+#else
+    if (i < 0) return -1;
+    s->tasks[i].priority = priority;
+    return 0;
+#endif
+}
+#endif // TM_PRIORITIES
+
+#if TM_EDF
+int8_t tmTaskSetDeadline_r(tmScheduler_t* s, tmTaskHandle_t handle, uint32_t deadline_ms) {
+    int16_t i = sTaskSlot(s, handle);
+    if (i < 0) return -1;
+    s->tasks[i].deadline = TM_MS_TO_TICKS(deadline_ms);
+    return 0;
+}
+
+int8_t tmTaskGetDeadlineMisses_r(tmScheduler_t* s, tmTaskHandle_t handle, uint32_t* misses) {
+    int16_t i = sTaskSlot(s, handle);
+    if (i < 0) return -1;
+    *misses = s->tasks[i].misses;
+    return 0;
+}
+#endif // TM_EDF
+
+/*
+ * Counting the passed ticks for the tasks. Once a task's countdown has
+ * passed zero it becomes ready and its countdown is restarted as if it
+ * had been reloaded on every tick.
+ */
+static void sTasksAdvance(tmScheduler_t* s, uint32_t ticks) {
+#if TM_ENGINE == TM_ENGINE_WHEEL
+    sWheelAdvance(s, ticks);
+#elif TM_ENGINE == TM_ENGINE_HEAP
+    // the tasks are started by tmUpdate by comparing the tick counter with the heap top
+    (void)s;
+    (void)ticks;
+#else
+    for (int i = 0; i < MAX_TASKS; i++) {
+        if (TASK_FUNC(s, i)) {
+            if (s->tasks[i].delay > 0) {
+                if (s->tasks[i].delay > ticks) {
+                    s->tasks[i].delay -= ticks;
+                } else {
+                    uint32_t over = ticks - s->tasks[i].delay;
+                    uint32_t count = 1;
+                    if (over >= s->tasks[i].period) {
+                        // several periods passed at once
+                        count += over / s->tasks[i].period;
+                        over %= s->tasks[i].period;
+                    }
+                    sRelease(s, i, count, s->tickCount + ticks - over);
+                    s->tasks[i].delay = s->tasks[i].period - over;
+                }
+            }
+        }
+    }
+#endif
+}
+
+void tmTick_r(tmScheduler_t* s) {
+    sTasksAdvance(s, 1);
+
+#if MAX_TIMERS
+    tmTimerProcess_r(s);
+#endif // MAX_TIMERS
+
+    sTimeAdvance(s, 1);
+}
 
-// Array with tasks
-static Task_s 			tasks[MAX_TASKS];
+#if TM_TICKLESS
+void tmTickAdvance_r(tmScheduler_t* s, uint32_t ticks) {
+    if (ticks == 0) return;
+    sTasksAdvance(s, ticks);
 
 #if MAX_TIMERS
-// Array with timers
-static OneShotTimer_s 	timers[MAX_TIMERS];
+    // the timers see the time of the last passed tick, as in tmTick
+    sTimeAdvance(s, ticks - 1);
+    tmTimerProcess_r(s);
+    sTimeAdvance(s, 1);
+#else
+    sTimeAdvance(s, ticks);
 #endif // MAX_TIMERS
+}
+
+uint32_t tmTicksToNextEvent_r(tmScheduler_t* s) {
+    uint32_t next = TM_TICKS_INFINITE;
+
+#if MAX_TIMERS && TM_TIMER_DEFERRED
+    if (s->timerQueueTail != s->timerQueueHead) return 0;
+#endif
+
+#if TM_ENGINE == TM_ENGINE_HEAP
+#if TM_PRIORITIES
+    for (int i = 0; i < MAX_TASKS; i++) {
+        if (TASK_FUNC(s, i) && sIsReady(s, i)) return 0;
+    }
+#elif TM_EVENTS
+    for (int w = 0; w < EVENT_WORDS; w++) {
+        if (s->eventMask[w]) return 0;
+    }
+#endif // TM_PRIORITIES
+    if (s->heapSize) {
+        int32_t left = (int32_t)(s->tasks[s->heap[0]].release - s->tickCount);
+        next = left > 0 ? (uint32_t)left : 0;
+    }
+#else
+    for (int i = 0; i < MAX_TASKS; i++) {
+        uint32_t left;
+        if (!TASK_FUNC(s, i)) continue;
+        if (sIsReady(s, i)) return 0;
+#if TM_ENGINE == TM_ENGINE_WHEEL
+        if (!s->tasks[i].period) continue;
+        left = s->tasks[i].expire - s->tickCount;
+#else
+        if (!s->tasks[i].delay) continue;
+        left = s->tasks[i].delay;
+#endif
+        if (left < next) next = left;
+    }
+#endif
+
+#if TM_TIMER_NODES
+    if (s->timerRoot) {
+        int32_t left = (int32_t)(s->timerRoot->expire - s->tickCount);
+        if (left <= 0) return 0;
+        if ((uint32_t)left < next) next = (uint32_t)left;
+    }
+#endif // TM_TIMER_NODES
+
+#if MAX_TIMERS
+    for (int i = 0; i < MAX_TIMERS; i++) {
+        tmTime_t passed;
+        uint32_t left;
+        if (!s->timers[i].active) continue;
+        // the timer fires on the tick that sees its delay passed
+        passed = sNow(s) - sTimerStamp(&s->timers[i]);
+        left = passed < s->timers[i].delay ? s->timers[i].delay - passed + 1 : 1;
+        if (left < next) next = left;
+    }
+#endif // MAX_TIMERS
+
+    return next;
+}
+#endif // TM_TICKLESS
+
+// Every host thread can run its own scheduler, so the running task is
+// tracked per thread there
+#if TM_HOST_EXECUTOR || defined(__unix__) || defined(__APPLE__)
+#define TM_THREAD_LOCAL __thread
+#else
+#define TM_THREAD_LOCAL
+#endif
+
+// The scheduler and the slot of the task being executed, -1 outside the tasks
+static TM_THREAD_LOCAL tmScheduler_t* currentSched;
+static TM_THREAD_LOCAL int16_t currentTask = -1;
+
+tmScheduler_t* tmSchedulerSelf(void) {
+    return currentTask < 0 ? &tmSchedulerDefault : currentSched;
+}
+
+tmTaskHandle_t tmTaskSelf(void) {
+    tmScheduler_t* s = currentSched;
+    int16_t i = currentTask;
+    if (i < 0 || !TASK_FUNC(s, i)) return TM_INVALID_HANDLE;
+    return (tmTaskHandle_t)(s->tasks[i].gen << 8 | i);
+}
 
-static volatile uint32_t millis;
+#if TM_COROUTINES
+tmTaskHandle_t tmTaskCreateCo_r(tmScheduler_t* s, void (*func)(void)) {
+    int16_t i;
+    if (!func) return TM_INVALID_HANDLE;
+    // the first resumption comes on the next tick
+    i = sTaskAlloc(s, func, 1, 0);
+    if (i < 0) return TM_INVALID_HANDLE;
+    return (tmTaskHandle_t)(s->tasks[i].gen << 8 | i);
+}
 
+uint16_t tmCoLine(void) {
+    return currentTask < 0 ? 0 : currentSched->tasks[currentTask].coLine;
+}
 
 /*
- * Custom idle function
- * It can be redefined in the right place.
+ * The task is re-armed so that the engine starts it again when the wait
+ * is over, until the next wait it stays periodic with this period, the
+ * extra starts are filtered by tmCoDue
  */
-__attribute__((weak)) void sIdleTask(void) {
-    ///__WFI(); 														//Switching to sleep until the next SysTick interrupt (optimization)
+#if TM_HOST_EXECUTOR
+// The coroutine request to delete the task, the waits are 1 tick at least
+#define CO_REQUEST_EXIT UINT32_MAX
+
+/*
+ * Only the tmUpdate thread changes the timing engine, so a coroutine on a
+ * worker leaves its wait or exit in the slot. Returns false if the task
+ * runs on the tmUpdate thread and the request is applied at once.
+ */
+static bool sCoRequest(tmScheduler_t* s, uint8_t i, uint32_t request) {
+    if (!__atomic_load_n(&s->tasks[i].running, __ATOMIC_ACQUIRE)) return false;
+    __atomic_store_n(&s->tasks[i].coRequest, request, __ATOMIC_RELAXED);
+    TM_ATOMIC_ADD(&s->coRequests, 1);
+    return true;
 }
+#endif // TM_HOST_EXECUTOR
 
-uint32_t get_millis (void) {
-    return millis;
-};
+void tmCoWait(uint16_t line, uint32_t ticks) {
+    tmScheduler_t* s = currentSched;
+    int16_t i = currentTask;
+    if (i < 0) return;
+    if (!ticks) ticks = 1;
+    s->tasks[i].coLine = line;
+    s->tasks[i].coWake = s->tickCount + ticks;
+#if TM_HOST_EXECUTOR
+    if (sCoRequest(s, i, ticks)) return;
+#endif
+    sTaskArm(s, i, ticks, 0);
+}
 
-int8_t tmAddTask(void (*func)(void), uint32_t period_ms) {
-    for (int i = 0; i < MAX_TASKS; i++) {
-        //Search for a free slot in the array
-        if (tasks[i].taskFunc == 0) {
-            tasks[i].taskFunc = func;
-            tasks[i].period_ms = period_ms;
-            tasks[i].delay_ms = period_ms;
-            tasks[i].isReady = 0;
-            return i;
+bool tmCoDue(void) {
+    int16_t i = currentTask;
+    return i < 0 || (int32_t)(currentSched->tickCount - currentSched->tasks[i].coWake) >= 0;
+}
+
+void tmCoExit(void) {
+    if (currentTask < 0) return;
+#if TM_HOST_EXECUTOR
+    if (sCoRequest(currentSched, currentTask, CO_REQUEST_EXIT)) return;
+#endif
+    sTaskFree(currentSched, currentTask);
+}
+#endif // TM_COROUTINES
+
+#if TM_EVENTS
+tmTaskHandle_t tmTaskCreateEvent_r(tmScheduler_t* s, void (*func)(void)) {
+    int16_t i;
+    if (!func) return TM_INVALID_HANDLE;
+    // without a period the task is started only by the signals
+    i = sTaskAlloc(s, func, 0, 0);
+    if (i < 0) return TM_INVALID_HANDLE;
+    return (tmTaskHandle_t)(s->tasks[i].gen << 8 | i);
+}
+
+int8_t tmSignal_r(tmScheduler_t* s, tmTaskHandle_t handle, uint32_t bits) {
+    int16_t i = sTaskSlot(s, handle);
+    if (i < 0) return -1;
+    TM_ATOMIC_OR(&s->tasks[i].events, bits);
+#if TM_ENGINE != TM_ENGINE_HEAP || TM_PRIORITIES
+    // one activation for any number of signals, they are not overruns; a
+    // pending activation already covers the signal
+#if TM_EDF
+    s->tasks[i].absDeadline = s->tickCount + sTaskDeadline(s, i);
+#endif
+    TM_ATOMIC_CAS(&s->tasks[i].pending, 0, 1);
+#if TM_READY_BITMAP
+    TM_ATOMIC_OR(&s->readyMask[i / 32], 1UL << (i % 32));
+#endif
+#else
+    TM_ATOMIC_OR(&s->eventMask[i / 32], 1UL << (i % 32));
+#endif
+    return 0;
+}
+
+uint32_t tmEventsTake(void) {
+    if (currentTask < 0) return 0;
+    return TM_ATOMIC_EXCHANGE(&currentSched->tasks[currentTask].events, 0);
+}
+#endif // TM_EVENTS
+
+/*
+ * Calling the task procedure, with the execution time measured when the
+ * statistics are enabled
+ */
+static inline void sTaskExec(tmScheduler_t* s, uint8_t i, void (*func)(void)) {
+    tmScheduler_t* callerSched = currentSched;
+    int16_t caller = currentTask;
+#if TM_EDF
+    // a release during the start must not move the deadline being checked
+    uint32_t deadline = s->tasks[i].absDeadline;
+#endif
+    currentSched = s;
+    currentTask = i;
+#if TM_SIM
+    // the simulation drives the default scheduler
+    if (s == &tmSchedulerDefault) tmSimOnDispatch((tmTaskHandle_t)(s->tasks[i].gen << 8 | i));
+#endif
+#if TM_TASK_STATS
+    TaskStats_s* st = &s->tasks[i].stats;
+    uint32_t start = TM_STATS_COUNTER();
+    func();
+    uint32_t time = TM_STATS_COUNTER() - start;
+    st->last = time;
+    if (!st->runs || time < st->min) st->min = time;
+    if (time > st->max) st->max = time;
+    st->total += time;
+    st->runs++;
+#else
+    func();
+#endif // TM_TASK_STATS
+#if TM_EDF
+    if ((int32_t)(s->tickCount - deadline) > 0) s->tasks[i].misses++;
+#endif
+    currentSched = callerSched;
+    currentTask = caller;
+}
+
+#if TM_HOST_EXECUTOR
+static void sDequePushBack(tmScheduler_t* s, uint8_t w, uint8_t i, void (*func)(void)) {
+    WorkDeque_s* d = &s->workDeque[w];
+    pthread_mutex_lock(&d->lock);
+    uint16_t pos = (d->first + d->count++) % MAX_TASKS;
+    d->slot[pos] = i;
+    d->func[pos] = func;
+    pthread_mutex_unlock(&d->lock);
+}
+
+/*
+ * Taking a task from the back (own deque) or the front (stealing).
+ * Returns the slot or -1 if the deque is empty.
+ */
+static int16_t sDequeTake(tmScheduler_t* s, uint8_t w, bool steal, void (**func)(void)) {
+    WorkDeque_s* d = &s->workDeque[w];
+    int16_t i = -1;
+    pthread_mutex_lock(&d->lock);
+    if (d->count) {
+        uint16_t pos;
+        if (steal) {
+            pos = d->first;
+            d->first = (d->first + 1) % MAX_TASKS;
+        } else {
+            pos = (d->first + d->count - 1) % MAX_TASKS;
         }
+        d->count--;
+        i = d->slot[pos];
+        *func = d->func[pos];
     }
-    return -1;
+    pthread_mutex_unlock(&d->lock);
+    return i;
 }
 
-int8_t tmUpdateTask(void (*func)(void), uint32_t period_ms) {
-    for (int i = 0; i < MAX_TASKS; i++) {
-        //Search for a free slot in the array
-        if (tasks[i].taskFunc == func) {
-            tasks[i].period_ms = period_ms;
-            tasks[i].delay_ms = period_ms;
-            tasks[i].isReady = 0;
-            return 0;
+static void* sWorker(void* arg) {
+    WorkDeque_s* own = arg;
+    tmScheduler_t* s = own->sched;
+    uint8_t self = (uint8_t)(own - s->workDeque);
+    for ( ; ; ) {
+        void (*func)(void) = 0;
+        int16_t i = sDequeTake(s, self, false, &func);
+        for (uint8_t k = 1; i < 0 && k < s->workerCount; k++) {
+            i = sDequeTake(s, (self + k) % s->workerCount, true, &func);
+        }
+        pthread_mutex_lock(&s->workLock);
+        if (i < 0) {
+            if (s->executorStop && s->workPending <= 0) {
+                pthread_mutex_unlock(&s->workLock);
+                return 0;
+            }
+            if (s->workPending <= 0) pthread_cond_wait(&s->workCond, &s->workLock);
+            pthread_mutex_unlock(&s->workLock);
+            continue;
         }
+        s->workPending--;
+        pthread_mutex_unlock(&s->workLock);
+        sTaskExec(s, i, func);
+        __atomic_store_n(&s->tasks[i].running, 0, __ATOMIC_RELEASE);
     }
-    return -1;
 }
 
-int8_t tmDeleteTask(void (*func)(void)) {
-    for (int i = 0; i < MAX_TASKS; i++) {
-        //Search for a func slot in the array
-        if (tasks[i].taskFunc == func) {
-            tasks[i].taskFunc = 0;
-            return 0;
+int8_t tmExecutorStart_r(tmScheduler_t* s, uint8_t threads) {
+    if (s->executorRunning || threads == 0 || threads > TM_EXECUTOR_MAX_THREADS) return -1;
+    s->executorStop = false;
+    s->workPending = 0;
+    pthread_mutex_init(&s->workLock, 0);
+    pthread_cond_init(&s->workCond, 0);
+    for (uint8_t w = 0; w < threads; w++) {
+        pthread_mutex_init(&s->workDeque[w].lock, 0);
+        s->workDeque[w].first = 0;
+        s->workDeque[w].count = 0;
+        s->workDeque[w].sched = s;
+    }
+    s->workerCount = threads;
+    s->executorRunning = true;
+    for (uint8_t w = 0; w < threads; w++) {
+        if (pthread_create(&s->workerThread[w], 0, sWorker, &s->workDeque[w]) != 0) {
+            s->workerCount = w;
+            tmExecutorStop_r(s);
+            return -1;
         }
     }
-    return -1;
+    return 0;
 }
 
-void tmTick(void) {
+void tmExecutorStop_r(tmScheduler_t* s) {
+    if (!s->executorRunning) return;
+    pthread_mutex_lock(&s->workLock);
+    s->executorStop = true;
+    pthread_cond_broadcast(&s->workCond);
+    pthread_mutex_unlock(&s->workLock);
+    for (uint8_t w = 0; w < s->workerCount; w++) {
+        pthread_join(s->workerThread[w], 0);
+    }
+    for (uint8_t w = 0; w < s->workerCount; w++) {
+        pthread_mutex_destroy(&s->workDeque[w].lock);
+    }
+    pthread_cond_destroy(&s->workCond);
+    pthread_mutex_destroy(&s->workLock);
+    s->workerCount = 0;
+    s->executorRunning = false;
+}
+
+/*
+ * A task that is still running on a worker is not started again, it stays
+ * ready until its previous run ends and its coroutine request is applied
+ */
+static inline bool sTaskBusy(tmScheduler_t* s, uint8_t i) {
+#if TM_COROUTINES
+    if (__atomic_load_n(&s->tasks[i].coRequest, __ATOMIC_RELAXED)) return true;
+#endif
+    return s->executorRunning && __atomic_load_n(&s->tasks[i].running, __ATOMIC_ACQUIRE);
+}
+
+#if TM_COROUTINES
+/*
+ * Applying the waits and exits of the coroutines whose runs on the workers
+ * have ended, on the tmUpdate thread
+ */
+static void sCoApply(tmScheduler_t* s) {
+    if (!__atomic_load_n(&s->coRequests, __ATOMIC_ACQUIRE)) return;
     for (int i = 0; i < MAX_TASKS; i++) {
-        if (tasks[i].taskFunc) {
-            if (tasks[i].delay_ms > 0) {
-                tasks[i].delay_ms--;
-                if (tasks[i].delay_ms == 0) {
-                    tasks[i].isReady = 1;
-                    tasks[i].delay_ms = tasks[i].period_ms;
-                }
-            }
+        uint32_t request;
+        // the request is stored before the worker clears running
+        if (__atomic_load_n(&s->tasks[i].running, __ATOMIC_ACQUIRE)) continue;
+        request = __atomic_load_n(&s->tasks[i].coRequest, __ATOMIC_RELAXED);
+        if (!request) continue;
+        __atomic_store_n(&s->tasks[i].coRequest, 0, __ATOMIC_RELAXED);
+        TM_ATOMIC_SUB(&s->coRequests, 1);
+        if (!TASK_FUNC(s, i)) continue;
+        if (request == CO_REQUEST_EXIT) {
+            sTaskFree(s, i);
+        } else {
+            sTaskArm(s, i, request, 0);
         }
     }
+}
+#endif // TM_COROUTINES
+#else
+static inline bool sTaskBusy(tmScheduler_t* s, uint8_t i) {
+    (void)s;
+    (void)i;
+    return false;
+}
+#endif // TM_HOST_EXECUTOR
+
+/*
+ * Starting the task, on a worker when the executor is running
+ */
+static void sTaskRun(tmScheduler_t* s, uint8_t i) {
+#if TM_HOST_EXECUTOR
+    if (s->executorRunning) {
+        uint8_t w = s->workerNext;
+        s->workerNext = (w + 1) % s->workerCount;
+        __atomic_store_n(&s->tasks[i].running, 1, __ATOMIC_RELAXED);
+        sDequePushBack(s, w, i, TASK_FUNC(s, i));
+        pthread_mutex_lock(&s->workLock);
+        s->workPending++;
+        pthread_cond_signal(&s->workCond);
+        pthread_mutex_unlock(&s->workLock);
+        return;
+    }
+#endif // TM_HOST_EXECUTOR
+    sTaskExec(s, i, TASK_FUNC(s, i));
+}
 
-#if MAX_TIMERS
-    tmTimerProcess();
-#endif // MAX_TIMERS
+#if !TM_PRIORITIES && TM_ENGINE != TM_ENGINE_HEAP
+/*
+ * Starting the task for its pending activations, a TM_CATCHUP_BURST task
+ * runs back to back until they are drained. Returns false if nothing was
+ * started.
+ */
+static bool sTaskDrain(tmScheduler_t* s, uint8_t i) {
+    bool executed = false;
+    while (TASK_FUNC(s, i) && !sTaskBusy(s, i) && sTakeActivation(s, i)) {
+        sTaskRun(s, i);
+        executed = true;
+        if (s->tasks[i].catchup != TM_CATCHUP_BURST) break;
+    }
+    return executed;
+}
+#endif // !TM_PRIORITIES && TM_ENGINE != TM_ENGINE_HEAP
 
-    millis++;
+#if TM_PRIORITIES
+/*
+ * The order of the ready tasks: the earlier absolute deadline with TM_EDF,
+ * then the higher priority
+ */
+static inline bool sPickBefore(tmScheduler_t* s, uint8_t i, uint8_t best) {
+#if TM_EDF
+    int32_t diff = (int32_t)(s->tasks[i].absDeadline - s->tasks[best].absDeadline);
+    if (diff) return diff < 0;
+#elif TM_STATIC_TASKS
+    // the priorities of the static tasks are in the constant table
+    (void)s;
+#endif
+    return TASK_PRIO(s, i) > TASK_PRIO(s, best);
 }
 
-void tmUpdate(void) {
-	static uint8_t taskExecuted = 0;
+/*
+ * Searching for the ready task that goes first (sPickBefore), among equal
+ * ones the lowest slot wins. Returns -1 if nothing is ready.
+ */
+static int16_t sPickReady(tmScheduler_t* s) {
+    int16_t best = -1;
+#if TM_READY_BITMAP
+    for (int w = 0; w < READY_WORDS; w++) {
+        uint32_t bits = s->readyMask[w];
+        while (bits) {
+            uint8_t i = w * 32 + __builtin_ctz(bits);
+            bits &= bits - 1;
+            if (!TASK_FUNC(s, i)) {
+                // the task was deleted while it was ready
+                sClearReady(s, i);
+            } else if (sTaskBusy(s, i)) {
+                continue;
+            } else if (best < 0 || sPickBefore(s, i, best)) {
+                best = i;
+            }
+        }
+    }
+#else
+    for (int i = 0; i < MAX_TASKS; i++) {
+        if (TASK_FUNC(s, i) && sIsReady(s, i) && !sTaskBusy(s, i)) {
+            if (best < 0 || sPickBefore(s, i, best)) best = i;
+        }
+    }
+#endif // TM_READY_BITMAP
+    return best;
+}
+#endif // TM_PRIORITIES
+
+void tmUpdate_r(tmScheduler_t* s) {
+	uint8_t taskExecuted = 0;
+#if TM_HOST_EXECUTOR && TM_COROUTINES
+    sCoApply(s);
+#endif
+#if MAX_TIMERS && TM_TIMER_DEFERRED
+    if (sTimerDrain(s)) taskExecuted = 1;
+#endif
+#if TM_TIMER_NODES
+    if (sNodesRun(s)) taskExecuted = 1;
+#endif
+#if TM_PRIORITIES
+    for ( ; ; ) {
+        int16_t i;
+#if TM_ENGINE == TM_ENGINE_HEAP
+        uint32_t count;
+        while ((i = sHeapTakeDue(s, s->tickCount, &count)) >= 0) {
+            sRelease(s, i, count, s->tasks[i].release - s->tasks[i].period);
+        }
+#endif
+        // the ready set is checked again after every task
+        i = sPickReady(s);
+        if (i < 0) break;
+        if (sTakeActivation(s, i)) {
+            sTaskRun(s, i);
+            taskExecuted = 1;
+        }
+    }
+#elif TM_ENGINE == TM_ENGINE_HEAP
+    uint32_t now = s->tickCount;
+    uint32_t count;
+    int16_t i;
+    while ((i = sHeapTakeDue(s, now, &count)) >= 0) {
+        s->tasks[i].overruns += count - 1;
+        // without pending counters the start of a task still running on a worker is lost
+        if (sTaskBusy(s, i)) {
+            s->tasks[i].overruns++;
+            continue;
+        }
+        if (s->tasks[i].catchup == TM_CATCHUP_ONCE && count > 1) sTaskRephase(s, i);
+        if (s->tasks[i].catchup != TM_CATCHUP_BURST) count = 1;
+        else if (count > 255) count = 255;
+        do {
+            sTaskRun(s, i);
+        } while (--count && TASK_FUNC(s, i) && !sTaskBusy(s, i));
+        taskExecuted = 1;
+    }
+#if TM_EVENTS
+    for (int w = 0; w < EVENT_WORDS; w++) {
+        uint32_t bits = TM_ATOMIC_EXCHANGE(&s->eventMask[w], 0);
+        while (bits) {
+            i = w * 32 + __builtin_ctz(bits);
+            bits &= bits - 1;
+            if (!TASK_FUNC(s, i)) continue;
+            if (sTaskBusy(s, i)) {
+                // the task stays signaled until its previous run ends
+                TM_ATOMIC_OR(&s->eventMask[w], 1UL << (i % 32));
+                continue;
+            }
+            sTaskRun(s, i);
+            taskExecuted = 1;
+        }
+    }
+#endif // TM_EVENTS
+#elif TM_READY_BITMAP
+    for (int w = 0; w < READY_WORDS; w++) {
+        uint32_t bits = s->readyMask[w];
+        while (bits) {
+            uint8_t i = w * 32 + __builtin_ctz(bits);
+            bits &= bits - 1;
+            if (!TASK_FUNC(s, i)) {
+                // the task was deleted while it was ready
+                sClearReady(s, i);
+            } else if (sTaskDrain(s, i)) {
+                taskExecuted = 1;
+            }
+        }
+    }
+#else
 	for (int i = 0; i < MAX_TASKS; i++) {
-		if (tasks[i].taskFunc && tasks[i].isReady) {
-			tasks[i].isReady = 0;
-			tasks[i].taskFunc();
-			taskExecuted = 1;
-		}
+		if (s->tasks[i].pending && sTaskDrain(s, i)) taskExecuted = 1;
 	}
+#endif
 	if (!taskExecuted) {
         // nothing needs to be done — we go into idle mode
-		sIdleTask();
+#if TM_TICKLESS
+		sIdleTickless_r(s, tmTicksToNextEvent_r(s));
+#else
+		sIdleTask_r(s);
+#endif
 	}
 }
 
@@ -104,13 +1664,34 @@ void tmUpdate(void) {
  * @return true 
  * @return false 
  */
-bool tmDelay_ms(uint32_t* timestamp, uint32_t delay) {
-    if (millis - *timestamp >= delay) {
-        *timestamp = millis;
+bool tmDelay_ms_r(tmScheduler_t* s, uint32_t* timestamp, uint32_t delay) {
+    uint32_t now = get_millis_r(s);
+    if (now - *timestamp >= delay) {
+        *timestamp = now;
+        return true;
+    }
+    return false;
+}
+
+bool tmDelay_us_r(tmScheduler_t* s, uint32_t* timestamp, uint32_t delay) {
+    uint32_t now = get_micros_r(s);
+    if (now - *timestamp >= delay) {
+        *timestamp = now;
+        return true;
+    }
+    return false;
+}
+
+#if TM_TIME64
+bool tmDelay64_ms_r(tmScheduler_t* s, uint64_t* timestamp, uint32_t delay) {
+    uint64_t now = get_millis64_r(s);
+    if (now - *timestamp >= delay) {
+        *timestamp = now;
         return true;
     }
     return false;
 }
+#endif // TM_TIME64
 
 #if MAX_TIMERS
 /**
@@ -123,14 +1704,18 @@ bool tmDelay_ms(uint32_t* timestamp, uint32_t delay) {
  * 5. If not active, start the timer,
  * 6. If the timer is already active, exit the function
  */
-int8_t tmTimerStartOnce(uint32_t delay_ms, void (*func)(void)) {
+static int8_t sTimerStart(tmScheduler_t* s, uint32_t delay, uint32_t period, uint16_t count, void (*func)(void)) {
 	for (int i = 0; i < MAX_TIMERS; i++) {
-		if (timers[i].callback == func)	{
-			timers[i].delay = delay_ms;
-			if (!timers[i].active) {
-				timers[i].active = 1;
-				timers[i].start_time = millis;
+		if (s->timers[i].callback == func)	{
+			TM_ENTER_CRITICAL();
+			s->timers[i].delay = delay;
+			s->timers[i].period = period;
+			s->timers[i].remaining = count;
+			if (!s->timers[i].active) {
+				s->timers[i].start_time = sNow(s);
+				TIMER_PUBLISH(&s->timers[i]);
 			}
+			TM_EXIT_CRITICAL();
 			return 0;
 		}
 	}
@@ -139,34 +1724,297 @@ int8_t tmTimerStartOnce(uint32_t delay_ms, void (*func)(void)) {
  * 
  */
     for (int i = 0; i < MAX_TIMERS; i++) {
-        if (timers[i].callback == 0) {
-            timers[i].active = 1;
-            timers[i].start_time = millis;
-            timers[i].delay = delay_ms;
-            timers[i].callback = func;
+        if (s->timers[i].callback == 0) {
+            TM_ENTER_CRITICAL();
+            s->timers[i].start_time = sNow(s);
+            s->timers[i].delay = delay;
+            s->timers[i].period = period;
+            s->timers[i].remaining = count;
+            s->timers[i].callback = func;
+            TIMER_PUBLISH(&s->timers[i]);
+            TM_EXIT_CRITICAL();
             return 0;
         }
     }
     return -1;
 }
 
-int8_t tmTimerDelete(void (*func)(void)) {
+int8_t tmTimerStartOnce_r(tmScheduler_t* s, uint32_t delay_ms, void (*func)(void)) {
+    return sTimerStart(s, TM_MS_TO_TICKS(delay_ms), 0, 0, func);
+}
+
+int8_t tmTimerStartOnce_us_r(tmScheduler_t* s, uint32_t delay_us, void (*func)(void)) {
+    return sTimerStart(s, TM_US_TO_TICKS(delay_us), 0, 0, func);
+}
+
+int8_t tmTimerStartPeriodic_r(tmScheduler_t* s, uint32_t period_ms, uint16_t count, void (*func)(void)) {
+    uint32_t period = TM_MS_TO_TICKS(period_ms);
+    if (!period) return -1;
+    return sTimerStart(s, period, period, count, func);
+}
+
+int8_t tmTimerStartPeriodic_us_r(tmScheduler_t* s, uint32_t period_us, uint16_t count, void (*func)(void)) {
+    uint32_t period = TM_US_TO_TICKS(period_us);
+    if (!period) return -1;
+    return sTimerStart(s, period, period, count, func);
+}
+
+/*
+ * Reloading the timer that has expired. The next expiry of a periodic
+ * timer is counted from the previous one, not from the time the callback
+ * runs, so the period does not drift. A late timer catches up one expiry
+ * per tick. One-shot timers and N-shot timers after their last start stop.
+ */
+static void sTimerReload(OneShotTimer_s* timer) {
+    if (!timer->period || timer->remaining == 1) {
+        timer->active = 0;
+        return;
+    }
+    if (timer->remaining) timer->remaining--;
+    timer->start_time += timer->delay;
+    timer->delay = timer->period;
+}
+
+int8_t tmTimerDelete_r(tmScheduler_t* s, void (*func)(void)) {
 	for (int i = 0; i < MAX_TIMERS; i++) {
-		if (timers[i].callback == func)	{
-			timers[i].callback = 0;
+		if (s->timers[i].callback == func)	{
+			// a periodic timer would otherwise keep reloading without a callback
+			TM_ENTER_CRITICAL();
+			s->timers[i].active = 0;
+			s->timers[i].callback = 0;
+#if TM_TIMER_DEFERRED
+			s->timers[i].gen++;
+#endif
+			TM_EXIT_CRITICAL();
 			return 0;
 		}
 	}
     return -1;
 }
 
-void tmTimerProcess(void) {
+void tmTimerProcess_r(tmScheduler_t* s) {
     for (int i = 0; i < MAX_TIMERS; i++) {
-        if (timers[i].active && (millis - timers[i].start_time >= timers[i].delay)) {
-            timers[i].active = 0;
-            if (timers[i].callback) timers[i].callback();
+        if (TIMER_ACTIVE(&s->timers[i]) && (sNow(s) - s->timers[i].start_time >= s->timers[i].delay)) {
+#if TM_TIMER_DEFERRED
+            // a full queue leaves the timer active, it is posted on the next tick
+            if (s->timers[i].callback && !sTimerPost(s, i)) continue;
+            sTimerReload(&s->timers[i]);
+#else
+            // reloaded first, so the callback can restart or delete its timer
+            sTimerReload(&s->timers[i]);
+            if (s->timers[i].callback) s->timers[i].callback();
+#endif
         }
     }
 }
 #endif // MAX_TIMERS
 
+
+/*
+ * The functions without a context work on the default scheduler
+ */
+uint32_t get_ticks(void) {
+    return get_ticks_r(&tmSchedulerDefault);
+}
+
+uint32_t get_millis(void) {
+    return get_millis_r(&tmSchedulerDefault);
+}
+
+uint32_t get_micros(void) {
+    return get_micros_r(&tmSchedulerDefault);
+}
+
+int8_t tmAddTask(void (*func)(void), uint32_t period_ms) {
+    return tmAddTask_r(&tmSchedulerDefault, func, period_ms);
+}
+
+#if TM_PRIORITIES
+int8_t tmAddTaskPrio(void (*func)(void), uint32_t period_ms, uint8_t priority) {
+    return tmAddTaskPrio_r(&tmSchedulerDefault, func, period_ms, priority);
+}
+#endif // TM_PRIORITIES
+
+int8_t tmUpdateTask(void (*func)(void), uint32_t period_ms) {
+    return tmUpdateTask_r(&tmSchedulerDefault, func, period_ms);
+}
+
+int8_t tmDeleteTask(void (*func)(void)) {
+    return tmDeleteTask_r(&tmSchedulerDefault, func);
+}
+
+tmTaskHandle_t tmTaskCreate(void (*func)(void), uint32_t period_ms) {
+    return tmTaskCreate_r(&tmSchedulerDefault, func, period_ms);
+}
+
+int8_t tmTaskSetPeriod(tmTaskHandle_t handle, uint32_t period_ms) {
+    return tmTaskSetPeriod_r(&tmSchedulerDefault, handle, period_ms);
+}
+
+tmTaskHandle_t tmTaskCreatePhase(void (*func)(void), uint32_t period_ms, uint32_t phase_ms) {
+    return tmTaskCreatePhase_r(&tmSchedulerDefault, func, period_ms, phase_ms);
+}
+
+int8_t tmTaskSetPhase(tmTaskHandle_t handle, uint32_t phase_ms) {
+    return tmTaskSetPhase_r(&tmSchedulerDefault, handle, phase_ms);
+}
+
+tmTaskHandle_t tmTaskCreate_us(void (*func)(void), uint32_t period_us) {
+    return tmTaskCreate_us_r(&tmSchedulerDefault, func, period_us);
+}
+
+int8_t tmTaskSetPeriod_us(tmTaskHandle_t handle, uint32_t period_us) {
+    return tmTaskSetPeriod_us_r(&tmSchedulerDefault, handle, period_us);
+}
+
+int8_t tmTaskRemove(tmTaskHandle_t handle) {
+    return tmTaskRemove_r(&tmSchedulerDefault, handle);
+}
+
+tmTaskHandle_t tmTaskFind(void (*func)(void)) {
+    return tmTaskFind_r(&tmSchedulerDefault, func);
+}
+
+int8_t tmTaskSetCatchup(tmTaskHandle_t handle, uint8_t policy) {
+    return tmTaskSetCatchup_r(&tmSchedulerDefault, handle, policy);
+}
+
+int8_t tmTaskGetOverruns(tmTaskHandle_t handle, uint32_t* overruns) {
+    return tmTaskGetOverruns_r(&tmSchedulerDefault, handle, overruns);
+}
+
+#if TM_TASK_STATS
+int8_t tmTaskGetStats(tmTaskHandle_t handle, TaskStats_s* stats) {
+    return tmTaskGetStats_r(&tmSchedulerDefault, handle, stats);
+}
+
+int8_t tmTaskResetStats(tmTaskHandle_t handle) {
+    return tmTaskResetStats_r(&tmSchedulerDefault, handle);
+}
+#endif // TM_TASK_STATS
+
+#if TM_PRIORITIES
+int8_t tmTaskSetPriority(tmTaskHandle_t handle, uint8_t priority) {
+    return tmTaskSetPriority_r(&tmSchedulerDefault, handle, priority);
+}
+#endif // TM_PRIORITIES
+
+#if TM_EDF
+int8_t tmTaskSetDeadline(tmTaskHandle_t handle, uint32_t deadline_ms) {
+    return tmTaskSetDeadline_r(&tmSchedulerDefault, handle, deadline_ms);
+}
+
+int8_t tmTaskGetDeadlineMisses(tmTaskHandle_t handle, uint32_t* misses) {
+    return tmTaskGetDeadlineMisses_r(&tmSchedulerDefault, handle, misses);
+}
+#endif // TM_EDF
+
+void tmTick(void) {
+    tmTick_r(&tmSchedulerDefault);
+}
+
+#if TM_TICKLESS
+void tmTickAdvance(uint32_t ticks) {
+    tmTickAdvance_r(&tmSchedulerDefault, ticks);
+}
+
+uint32_t tmTicksToNextEvent(void) {
+    return tmTicksToNextEvent_r(&tmSchedulerDefault);
+}
+#endif // TM_TICKLESS
+
+#if TM_COROUTINES
+tmTaskHandle_t tmTaskCreateCo(void (*func)(void)) {
+    return tmTaskCreateCo_r(&tmSchedulerDefault, func);
+}
+#endif // TM_COROUTINES
+
+#if TM_EVENTS
+tmTaskHandle_t tmTaskCreateEvent(void (*func)(void)) {
+    return tmTaskCreateEvent_r(&tmSchedulerDefault, func);
+}
+
+int8_t tmSignal(tmTaskHandle_t handle, uint32_t bits) {
+    return tmSignal_r(&tmSchedulerDefault, handle, bits);
+}
+#endif // TM_EVENTS
+
+#if TM_HOST_EXECUTOR
+int8_t tmExecutorStart(uint8_t threads) {
+    return tmExecutorStart_r(&tmSchedulerDefault, threads);
+}
+
+void tmExecutorStop(void) {
+    tmExecutorStop_r(&tmSchedulerDefault);
+}
+#endif // TM_HOST_EXECUTOR
+
+void tmUpdate(void) {
+    tmUpdate_r(&tmSchedulerDefault);
+}
+
+bool tmDelay_ms(uint32_t* timestamp, uint32_t delay) {
+    return tmDelay_ms_r(&tmSchedulerDefault, timestamp, delay);
+}
+
+bool tmDelay_us(uint32_t* timestamp, uint32_t delay) {
+    return tmDelay_us_r(&tmSchedulerDefault, timestamp, delay);
+}
+
+#if TM_TIME64
+uint64_t get_millis64(void) {
+    return get_millis64_r(&tmSchedulerDefault);
+}
+
+bool tmDelay64_ms(uint64_t* timestamp, uint32_t delay) {
+    return tmDelay64_ms_r(&tmSchedulerDefault, timestamp, delay);
+}
+#endif // TM_TIME64
+
+#if MAX_TIMERS
+int8_t tmTimerStartOnce(uint32_t delay_ms, void (*func)(void)) {
+    return tmTimerStartOnce_r(&tmSchedulerDefault, delay_ms, func);
+}
+
+int8_t tmTimerStartOnce_us(uint32_t delay_us, void (*func)(void)) {
+    return tmTimerStartOnce_us_r(&tmSchedulerDefault, delay_us, func);
+}
+
+int8_t tmTimerStartPeriodic(uint32_t period_ms, uint16_t count, void (*func)(void)) {
+    return tmTimerStartPeriodic_r(&tmSchedulerDefault, period_ms, count, func);
+}
+
+int8_t tmTimerStartPeriodic_us(uint32_t period_us, uint16_t count, void (*func)(void)) {
+    return tmTimerStartPeriodic_us_r(&tmSchedulerDefault, period_us, count, func);
+}
+
+int8_t tmTimerDelete(void (*func)(void)) {
+    return tmTimerDelete_r(&tmSchedulerDefault, func);
+}
+
+void tmTimerProcess(void) {
+    tmTimerProcess_r(&tmSchedulerDefault);
+}
+#endif // MAX_TIMERS
+
+#if TM_TIMER_NODES
+void tmTimerNodeStart(TimerNode_s* t, uint32_t delay_ms) {
+    tmTimerNodeStart_r(&tmSchedulerDefault, t, delay_ms);
+}
+
+void tmTimerNodeStart_us(TimerNode_s* t, uint32_t delay_us) {
+    tmTimerNodeStart_us_r(&tmSchedulerDefault, t, delay_us);
+}
+
+void tmTimerNodeRestart(TimerNode_s* t, uint32_t delay_ms) {
+    tmTimerNodeRestart_r(&tmSchedulerDefault, t, delay_ms);
+}
+
+void tmTimerNodeRestart_us(TimerNode_s* t, uint32_t delay_us) {
+    tmTimerNodeRestart_us_r(&tmSchedulerDefault, t, delay_us);
+}
+
+bool tmTimerNodeCancel(TimerNode_s* t) {
+    return tmTimerNodeCancel_r(&tmSchedulerDefault, t);
+}
+#endif // TM_TIMER_NODES
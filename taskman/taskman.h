@@ -4,30 +4,473 @@
 #include "stdbool.h"
 #include "stdint.h"
 
+/**
+ * @brief Static task table. 1 - the task set is fixed at build time by the
+ * X-macro TM_TASK_LIST(X) of the user file taskman_tasks.h, one
+ * X(func, period_ms, priority) per task. The procedures, the initial
+ * periods and the priorities are kept in a constant table in flash, the
+ * RAM only holds the countdowns, and the tasks are ready before main
+ * without any tmAddTask calls. MAX_TASKS is the number of the listed tasks,
+ * tasks cannot be added, tmDeleteTask and tmTaskRemove only stop a task
+ * and tmTaskSetPeriod starts it again.
+ * 
+ * Example taskman_tasks.h:
+ * @code{c}
+ * #define TM_TASK_LIST(X)         \
+ *     X(vTaskBlink,   500, 0)     \
+ *     X(vTaskSensor,   10, 2)     \
+ *     X(vTaskReport, 1000, 1)
+ * @endcode
+ * The handles of the tasks are TM_STATIC_HANDLE(vTaskSensor) and so on.
+ * 
+ */
+#ifndef TM_STATIC_TASKS
+#define TM_STATIC_TASKS 0
+#endif
+
+#if TM_STATIC_TASKS
+#include "taskman_tasks.h"
+
+#ifdef MAX_TASKS
+#error "MAX_TASKS is the number of the tasks in TM_TASK_LIST with TM_STATIC_TASKS"
+#endif
+#define TM_TASK_COUNT_ONE(func, period_ms, priority) + 1
+#define MAX_TASKS (0 TM_TASK_LIST(TM_TASK_COUNT_ONE))
+
+// The procedures of the static tasks and their slot numbers
+#define TM_TASK_DECLARE(func, period_ms, priority) void func(void);
+TM_TASK_LIST(TM_TASK_DECLARE)
+#define TM_TASK_ID_ENUM(func, period_ms, priority) TM_TASK_ID_##func,
+enum { TM_TASK_LIST(TM_TASK_ID_ENUM) };
+#endif // TM_STATIC_TASKS
+
 /**
  * @brief The maximum number of tasks. The higher the number, the 
  * more memory is allocated to store the task parameters. 255 is the 
  * maximum number.
  * 
  */
+#ifndef MAX_TASKS
 #define MAX_TASKS 10
+#endif
 
 /**
  * @brief The maximum number of timers. 0 - timers are not activated. 
  * 255 is the maximum number.
  * 
  */
+#ifndef MAX_TIMERS
 #define MAX_TIMERS 5
+#endif
+
+#if MAX_TIMERS
+/**
+ * @brief Deferred timer callbacks. 1 - an expired timer only posts its
+ * callback to a lock-free single-producer/single-consumer queue in tmTick,
+ * and the callbacks are started from tmUpdate, so the interrupt time does
+ * not depend on what the callbacks do.
+ * 
+ */
+#ifndef TM_TIMER_DEFERRED
+#define TM_TIMER_DEFERRED 0
+#endif
+
+#if TM_TIMER_DEFERRED
+/**
+ * @brief The size of the deferred callback queue, a power of two up to 128.
+ * If the queue is full, the expired timer stays active and is posted on
+ * the next tick.
+ * 
+ */
+#ifndef TM_TIMER_QUEUE_SIZE
+#define TM_TIMER_QUEUE_SIZE 8
+#endif
+#endif // TM_TIMER_DEFERRED
+#endif // MAX_TIMERS
+
+/**
+ * @brief Intrusive timers. 1 - any number of timers (TimerNode_s) kept in
+ * the memory of the user, for example one per connection, are ordered in
+ * a pairing heap: start O(1), restart and cancel O(log n) amortized. The
+ * tick does not touch them, tmUpdate compares the tick counter with the
+ * heap top and starts the expired ones, so a pass costs one comparison
+ * plus O(log n) per expired timer. Independent of MAX_TIMERS.
+ * 
+ */
+#ifndef TM_TIMER_NODES
+#define TM_TIMER_NODES 0
+#endif
+
+/**
+ * @brief Task timing engines.
+ * TM_ENGINE_COUNTDOWN - every tick decrements the delay of every task, the
+ * tick cost grows with MAX_TASKS.
+ * TM_ENGINE_WHEEL - tasks are kept in a hashed timing wheel by absolute
+ * expiry tick, every tick only visits the bucket that is due.
+ * TM_ENGINE_HEAP - every task stores the absolute time of its next start,
+ * the tasks are kept in a binary min-heap. The tick does not touch the tasks
+ * at all, tmUpdate compares the tick counter with the heap top and starts the due
+ * tasks in deadline order. Rescheduling costs O(log MAX_TASKS).
+ * 
+ */
+#define TM_ENGINE_COUNTDOWN 0
+#define TM_ENGINE_WHEEL     1
+#define TM_ENGINE_HEAP      2
+
+/**
+ * @brief The engine used for periodic tasks. Can be set from the compiler
+ * command line, for example -DTM_ENGINE=TM_ENGINE_WHEEL.
+ * 
+ */
+#ifndef TM_ENGINE
+#define TM_ENGINE TM_ENGINE_COUNTDOWN
+#endif
+
+#if TM_ENGINE == TM_ENGINE_WHEEL
+/**
+ * @brief The number of timing wheel buckets, must be a power of two. Tasks
+ * whose expiry ticks differ by a multiple of this value share a bucket.
+ * 
+ */
+#ifndef TM_WHEEL_SIZE
+#define TM_WHEEL_SIZE 32
+#endif
+#endif // TM_ENGINE_WHEEL
+
+/**
+ * @brief Tickless mode. 1 - the periodic tmTick can be replaced by a one-shot
+ * timer: the scheduler reports the ticks until the next task or timer with
+ * tmTicksToNextEvent and catches up the slept ticks with tmTickAdvance.
+ * 
+ */
+#ifndef TM_TICKLESS
+#define TM_TICKLESS 0
+#endif
+
+/**
+ * @brief Earliest-deadline-first dispatch. 1 - every release of a task gets
+ * an absolute deadline, the release tick plus the relative deadline of the
+ * task (tmTaskSetDeadline, the period by default), and tmUpdate starts the
+ * ready task with the earliest one. The priorities only break the ties.
+ * A start that completes after its deadline is counted as a miss.
+ * Turns TM_PRIORITIES on, whose ready set it uses.
+ * 
+ */
+#ifndef TM_EDF
+#define TM_EDF 0
+#endif
+
+/**
+ * @brief Fixed task priorities. 1 - every task has a priority (tmAddTaskPrio),
+ * tmUpdate always starts the ready task with the highest priority and checks
+ * the ready set again after every completed task. Tasks of equal priority
+ * are started in the order of their slots.
+ * 
+ */
+#ifndef TM_PRIORITIES
+#define TM_PRIORITIES TM_EDF
+#endif
+
+#if TM_EDF && !TM_PRIORITIES
+#error "TM_EDF needs the ready set of TM_PRIORITIES"
+#endif
+
+/**
+ * @brief Ready set as a bitmap. 1 - the tick sets the bit of a ready task
+ * atomically and tmUpdate walks only the set bits with count-trailing-zeros,
+ * so an idle pass costs one load per 32 tasks. Not used by TM_ENGINE_HEAP,
+ * which has no ready flags.
+ * 
+ */
+#ifndef TM_READY_BITMAP
+#define TM_READY_BITMAP 0
+#endif
+
+#if TM_READY_BITMAP && TM_ENGINE == TM_ENGINE_HEAP
+#error "TM_READY_BITMAP is not used by TM_ENGINE_HEAP"
+#endif
+
+/**
+ * @brief Atomic operations on the ready set shared with the tick, each one
+ * returns the previous value. By default the GCC builtins are used, a port
+ * without them (for example Cortex-M0) can define its own versions with
+ * interrupts disabled.
+ * 
+ */
+#ifndef TM_ATOMIC_OR
+#define TM_ATOMIC_OR(ptr, val)       __atomic_fetch_or((ptr), (val), __ATOMIC_RELAXED)
+#define TM_ATOMIC_AND(ptr, val)      __atomic_fetch_and((ptr), (val), __ATOMIC_RELAXED)
+#define TM_ATOMIC_ADD(ptr, val)      __atomic_fetch_add((ptr), (val), __ATOMIC_RELAXED)
+#define TM_ATOMIC_SUB(ptr, val)      __atomic_fetch_sub((ptr), (val), __ATOMIC_RELAXED)
+#define TM_ATOMIC_EXCHANGE(ptr, val) __atomic_exchange_n((ptr), (val), __ATOMIC_RELAXED)
+#endif
+
+// Storing val if the value is old, true if it was stored
+#ifndef TM_ATOMIC_CAS
+#define TM_ATOMIC_CAS(ptr, old, val) __sync_bool_compare_and_swap((ptr), (old), (val))
+#endif
+
+/**
+ * @brief Virtual-time simulation backend for host builds (taskman_sim.c).
+ * 1 - tmSimRun advances the time straight to the next event instead of
+ * waiting for real ticks, and every task start can be traced and replayed.
+ * Needs TM_TICKLESS.
+ * 
+ */
+#ifndef TM_SIM
+#define TM_SIM 0
+#endif
+
+#if TM_SIM && !TM_TICKLESS
+#error "TM_SIM needs TM_TICKLESS"
+#endif
+
+/**
+ * @brief Multi-threaded executor for host builds (POSIX threads). 1 - after
+ * tmExecutorStart the ready tasks are started on a pool of worker threads
+ * with work stealing instead of the tmUpdate thread. A task never runs
+ * concurrently with itself.
+ * 
+ */
+#ifndef TM_HOST_EXECUTOR
+#define TM_HOST_EXECUTOR 0
+#endif
+
+#if TM_SIM && TM_HOST_EXECUTOR
+#error "TM_SIM runs the tasks on one thread, TM_HOST_EXECUTOR is not deterministic"
+#endif
+
+#if TM_HOST_EXECUTOR
+/**
+ * @brief The maximum number of worker threads
+ * 
+ */
+#ifndef TM_EXECUTOR_MAX_THREADS
+#define TM_EXECUTOR_MAX_THREADS 8
+#endif
+#endif // TM_HOST_EXECUTOR
+
+/**
+ * @brief Per-task execution time statistics. 1 - the number of runs and the
+ * last, min, max and total execution time are recorded for every task and
+ * can be read with tmTaskGetStats. 0 - nothing is compiled in.
+ * The time is measured with TM_STATS_COUNTER(), a free-running 32-bit
+ * counter. By default it is DWT->CYCCNT on Cortex-M3/M4/M7/M33 (CPU cycles),
+ * nanoseconds of CLOCK_MONOTONIC on host builds, or the TSC when
+ * TM_STATS_RDTSC is 1 on x86. Any other counter can be defined before
+ * including the header.
+ * 
+ */
+#ifndef TM_TASK_STATS
+#define TM_TASK_STATS 0
+#endif
+
+#ifndef TM_STATS_RDTSC
+#define TM_STATS_RDTSC 0
+#endif
+
+/**
+ * @brief Stackless coroutine tasks. 1 - the tasks created with
+ * tmTaskCreateCo can wait with TM_AWAIT_DELAY, TM_AWAIT_UNTIL and TM_YIELD
+ * and resume at the same point. The waits re-arm the task in the timing
+ * engine, so a waiting coroutine costs nothing until it is due. With
+ * TM_HOST_EXECUTOR a coroutine on a worker only leaves its wait or exit
+ * in the slot, tmUpdate applies it once the run has ended.
+ * 
+ */
+#ifndef TM_COROUTINES
+#define TM_COROUTINES 0
+#endif
+
+/**
+ * @brief Event-triggered tasks. 1 - a task can be started by tmSignal from
+ * an interrupt: the event bits are set atomically and the task becomes
+ * ready, tmUpdate starts it on the next pass without any polling.
+ * 
+ */
+#ifndef TM_EVENTS
+#define TM_EVENTS 0
+#endif
+
+/**
+ * @brief Tick period in microseconds, tmTick must be called at this rate.
+ * The periods and delays given in ms or us are rounded up to whole ticks,
+ * so a faster tick (for example 250 us) allows sub-millisecond tasks.
+ * 
+ */
+#ifndef TM_TICK_US
+#define TM_TICK_US 1000
+#endif
+
+/**
+ * @brief Automatic phase staggering. 1 - the tasks added without an
+ * explicit phase get their first start chosen so that their starts fall
+ * as far as possible from the starts of the other tasks (see
+ * tmTaskCreatePhase with TM_PHASE_AUTO). 0 - the first start comes after
+ * a full period. A period change (tmTaskSetPeriod, tmUpdateTask) always
+ * restarts the full period and keeps O(1); tmTaskSetPhase with
+ * TM_PHASE_AUTO staggers an existing task again.
+ * 
+ */
+#ifndef TM_STAGGER
+#define TM_STAGGER 0
+#endif
+
+/**
+ * @brief 64-bit time base. 1 - the tick also counts a high word, so the
+ * time does not wrap after 49.7 days (at 1 ms ticks). get_millis64 reads it consistently
+ * without disabling interrupts (announced carry, the reading never waits for the tick), the timers and
+ * tmDelay_ms use it internally.
+ * 
+ */
+#ifndef TM_TIME64
+#define TM_TIME64 0
+#endif
+
+/**
+ * @brief Locking of the data shared between tmTick and the main loop. By
+ * default it is empty, for the Cortex-M it can be defined before including
+ * the header as __disable_irq() / __enable_irq().
+ * 
+ */
+#ifndef TM_ENTER_CRITICAL
+#define TM_ENTER_CRITICAL()
+#define TM_EXIT_CRITICAL()
+#endif
+
+/**
+ * @brief Conversion of the time to ticks, rounded up
+ * 
+ */
+#define TM_US_TO_TICKS(us) ((uint32_t)(((uint64_t)(us) + TM_TICK_US - 1) / TM_TICK_US))
+#if TM_TICK_US == 1000
+#define TM_MS_TO_TICKS(ms) ((uint32_t)(ms))
+#else
+#define TM_MS_TO_TICKS(ms) TM_US_TO_TICKS((uint64_t)(ms) * 1000)
+#endif
+
+/**
+ * @brief The type of the absolute time stamps
+ * 
+ */
+#if TM_TIME64
+typedef uint64_t tmTime_t;
+#else
+typedef uint32_t tmTime_t;
+#endif
+
+/**
+ * @brief Task handle: the slot number in the low byte and the generation
+ * of the slot in the high byte. A handle becomes stale when its task is
+ * deleted, even if the slot is taken by a new task.
+ * 
+ */
+typedef uint16_t tmTaskHandle_t;
+
+/**
+ * @brief The handle value that never refers to a task
+ * 
+ */
+#define TM_INVALID_HANDLE 0
+
+#if TM_STATIC_TASKS
+// The handle of a static task, the generation of its slot never changes
+#define TM_STATIC_HANDLE(func) ((tmTaskHandle_t)(1 << 8 | TM_TASK_ID_##func))
+#endif
+
+#if TM_TASK_STATS
+/**
+ * @brief Execution time statistics of a task, in units of TM_STATS_COUNTER.
+ * The average time is total / runs. The counter is 32-bit, so a single run
+ * longer than its wrap (about 4.3 s of the host nanoseconds, 1.4 s of a
+ * 3 GHz TSC, 25 s of a 168 MHz CYCCNT) is recorded modulo 2^32 as a short one.
+ * 
+ */
+typedef struct {
+    uint32_t runs;
+    uint32_t last;
+    uint32_t min;
+    uint32_t max;
+    uint64_t total;
+} TaskStats_s;
+#endif // TM_TASK_STATS
+
+/**
+ * @brief Catch-up policies of a task whose start was missed because the main
+ * loop did not get to it within its period (an overrun).
+ * TM_CATCHUP_SKIP - the missed starts are dropped, the task runs once and
+ * keeps its phase. This is the default.
+ * TM_CATCHUP_ONCE - the task runs once and its period restarts from that
+ * moment, the phase of its starts moves.
+ * TM_CATCHUP_BURST - the task runs once for every missed start (up to 255),
+ * back to back within one tmUpdate. With TM_PRIORITIES a ready task of a
+ * higher priority still goes first.
+ * 
+ */
+#define TM_CATCHUP_SKIP  0
+#define TM_CATCHUP_ONCE  1
+#define TM_CATCHUP_BURST 2
+
+#if TM_STATIC_TASKS
+/**
+ * @brief The constant part of a static task
+ * 
+ */
+typedef struct {
+    void (*taskFunc)(void);
+    uint32_t period;        // initial period in ticks
+    uint8_t priority;
+} TaskConst_s;
+#endif // TM_STATIC_TASKS
 
 /**
  * @brief Task parameter storage structure
  * 
  */
 typedef struct {
+#if !TM_STATIC_TASKS
     void (*taskFunc)(void);
-    uint32_t period_ms; 
-    uint32_t delay_ms; 
-    uint8_t isReady;
+#endif
+    uint32_t period;        // in ticks
+#if TM_ENGINE == TM_ENGINE_WHEEL
+    uint32_t expire;        // absolute tick of the next start
+    uint8_t next;           // next task in the wheel bucket (index + 1, 0 - end)
+#elif TM_ENGINE == TM_ENGINE_HEAP
+    uint32_t release;       // absolute tick of the next start
+    uint8_t heapPos;        // position in the heap + 1, 0 - not in the heap
+#else
+    uint32_t delay;         // ticks to the next start
+#endif
+#if TM_ENGINE != TM_ENGINE_HEAP || TM_PRIORITIES
+    volatile uint8_t pending;   // activations not started yet, saturates at 255
+#endif
+    uint8_t catchup;        // TM_CATCHUP_...
+    uint32_t overruns;      // starts released while the previous one was still pending
+#if TM_PRIORITIES && !TM_STATIC_TASKS
+    uint8_t priority;       // 0 - the lowest
+#endif
+#if TM_EDF
+    uint32_t deadline;      // relative deadline in ticks, 0 - the period
+    uint32_t absDeadline;   // absolute tick of the deadline of the latest release
+    uint32_t misses;        // starts completed after their deadline
+#endif
+    uint8_t gen;            // generation of the slot, 1..255 once used
+#if TM_EVENTS
+    volatile uint32_t events;   // bits signaled and not taken yet
+#endif
+#if TM_COROUTINES
+    uint16_t coLine;        // resumption point of the coroutine, 0 - the start
+    uint32_t coWake;        // absolute tick the coroutine waits for
+#endif
+#if TM_HOST_EXECUTOR
+    uint8_t running;        // the task is queued or running on a worker
+#if TM_COROUTINES
+    volatile uint32_t coRequest;    // wait in ticks or exit asked on a worker, 0 - none
+#endif
+#endif
+#if TM_TASK_STATS
+    TaskStats_s stats;
+#endif
 } Task_s;
 
 #if MAX_TIMERS
@@ -37,12 +480,156 @@ typedef struct {
  */
 typedef struct {
     uint8_t active;
-    uint32_t start_time;
-    uint32_t delay;
+    tmTime_t start_time;    // in ticks
+    uint32_t delay;         // ticks from start_time to the next expiry
+    uint32_t period;        // reload in ticks, 0 - one-shot
+    uint16_t remaining;     // starts left of an N-shot timer, 0 - unlimited
     void (*callback)(void);
+#if TM_TIMER_DEFERRED
+    uint8_t gen;            // changed on delete, the queued starts of the old timer are dropped
+#endif
 } OneShotTimer_s;
 #endif // MAX_TIMERS
 
+#if TM_TIMER_NODES
+/**
+ * @brief Intrusive timer, placed by the user in its own data and set up
+ * with tmTimerNodeInit. The links are used only by the scheduler.
+ * 
+ */
+typedef struct TimerNode_s {
+    struct TimerNode_s* child;  // the first child in the pairing heap
+    struct TimerNode_s* next;   // the next sibling
+    struct TimerNode_s* prev;   // the previous sibling, the parent for the first child
+    uint32_t expire;            // absolute tick of the place in the heap
+    uint32_t deadline;          // absolute tick of the expiry, later than expire after a lazy restart
+    uint8_t active;
+    void (*callback)(void* arg);
+    void* arg;
+} TimerNode_s;
+#endif // TM_TIMER_NODES
+
+#if TM_HOST_EXECUTOR
+#include <pthread.h>
+
+/**
+ * @brief Work deque of an executor thread. The owner takes the newest task
+ * from the back, idle workers steal the oldest ones from the front of the
+ * other deques. A task is in flight at most once, so a deque never holds
+ * more than MAX_TASKS entries.
+ * 
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    uint8_t slot[MAX_TASKS];
+    void (*func[MAX_TASKS])(void);
+    uint16_t first;
+    uint16_t count;
+    struct tmScheduler_s* sched;    // the scheduler the worker belongs to
+} WorkDeque_s;
+#endif // TM_HOST_EXECUTOR
+
+/**
+ * @brief Scheduler instance: the tasks, the timers and the time base of one
+ * scheduler. Every function has a variant with the _r suffix that takes the
+ * instance as the first argument, the functions without it work on
+ * tmSchedulerDefault. The instances share nothing, so on the host every
+ * thread (or core) can run its own scheduler without locks.
+ * A zero-filled instance is an empty scheduler, tmSchedulerInit resets one.
+ * 
+ */
+typedef struct tmScheduler_s {
+    Task_s tasks[MAX_TASKS];
+#if MAX_TIMERS
+    OneShotTimer_s timers[MAX_TIMERS];
+#endif
+#if TM_TIMER_NODES
+    TimerNode_s* timerRoot;     // the pairing heap of the intrusive timers
+#endif
+    volatile uint32_t tickCount;    // ticks of TM_TICK_US
+#if TM_TIME64
+    // High word of the 64-bit time and its next value, stored by the tick
+    // before the low word wraps and differing from it only during the carry
+    volatile uint32_t tickCountHigh;
+    volatile uint32_t tickCountCarry;
+#endif
+#if MAX_TIMERS && TM_TIMER_DEFERRED
+    // Expired timers as gen << 8 | index, written by the tick and read by tmUpdate
+    volatile uint16_t timerQueue[TM_TIMER_QUEUE_SIZE];
+    volatile uint8_t timerQueueHead;    // changed only by the tick
+    volatile uint8_t timerQueueTail;    // changed only by tmUpdate
+#endif
+#if TM_READY_BITMAP
+    // Bitmap of the tasks with pending activations, bit i of word i / 32 is the task i
+    volatile uint32_t readyMask[(MAX_TASKS + 31) / 32];
+#endif
+#if TM_EVENTS && TM_ENGINE == TM_ENGINE_HEAP && !TM_PRIORITIES
+    // Without pending counters the signaled tasks are kept in this bitmap
+    volatile uint32_t eventMask[(MAX_TASKS + 31) / 32];
+#endif
+#if TM_ENGINE == TM_ENGINE_WHEEL
+    // Timing wheel buckets, each one is a list of tasks (index + 1, 0 - empty)
+    uint8_t wheel[TM_WHEEL_SIZE];
+#elif TM_ENGINE == TM_ENGINE_HEAP
+    // Min-heap of task indexes ordered by the time of the next start
+    uint8_t heap[MAX_TASKS];
+    uint8_t heapSize;
+#endif
+#if TM_HOST_EXECUTOR
+    WorkDeque_s workDeque[TM_EXECUTOR_MAX_THREADS];
+    pthread_t workerThread[TM_EXECUTOR_MAX_THREADS];
+    uint8_t workerCount;
+    uint8_t workerNext;
+    volatile bool executorRunning;
+    bool executorStop;
+    // Sleeping of the idle workers, workPending is the number of queued tasks
+    pthread_mutex_t workLock;
+    pthread_cond_t workCond;
+    int32_t workPending;
+#if TM_COROUTINES
+    volatile uint32_t coRequests;   // coroutine requests not applied by tmUpdate yet
+#endif
+#endif // TM_HOST_EXECUTOR
+} tmScheduler_t;
+
+/**
+ * @brief The scheduler used by the functions without the _r suffix. With
+ * TM_STATIC_TASKS it holds the tasks of the static table.
+ * 
+ */
+extern tmScheduler_t tmSchedulerDefault;
+
+/**
+ * @brief Resetting the scheduler: no tasks, no timers and the time at 0.
+ * With TM_STATIC_TASKS the instance gets the tasks of the static table
+ * stopped, tmTaskSetPeriod_r starts them. Must not be called while the
+ * executor of the instance is running.
+ * 
+ * Example usage:
+ * @code{c}
+ * static tmScheduler_t radio;
+ * 
+ * void* radio_thread(void* arg) {
+ *  tmSchedulerInit(&radio);
+ *  tmTaskCreate_r(&radio, vTaskRadioPoll, 5);
+ * 
+ *  for ( ; ; ) {
+ *   tmTick_r(&radio);
+ *   tmUpdate_r(&radio);
+ *   usleep(1000);
+ *  }
+ * }
+ * @endcode
+ */
+void tmSchedulerInit(tmScheduler_t* s);
+
+/**
+ * @brief The scheduler of the task being executed, the default one outside
+ * the tasks
+ * 
+ */
+tmScheduler_t* tmSchedulerSelf(void);
+
 /**
  * @code{c}
  * int8_t tmAddTask(
@@ -51,29 +638,399 @@ typedef struct {
  *                  );
  * @endcode
  *
- * The procedure is designed to add a new task to the taskmanager.
+ * The procedure is designed to add a new task to the taskmanager.
+ *
+ * @param (*func)(void) procedure to add to the procedure startup list
+ *
+ * @param period_ms the start period of the procedure.
+ *
+ * @return The returned parameter is the sequential number of the task in the
+ * task list, or -1 if it was added unsuccessfully.
+ *
+ * Example usage:
+ * @code{c}
+ * void vTaskCount( void ) {
+ *  static counter = 0;
+ *  counter++;
+ * }
+ *
+ * void vTaskLed( void ) {
+ *  led_blink();
+ * }
+ *
+ * void main {
+ *  tmAddTask(vTaskCount, 10);
+ *  tmAddTask(vTaskLed, 500);
+ * 
+ *  for ( ; ; ) {
+ *   tmUpdate();
+ *  }
+ * }
+ * @endcode
+ */
+
+int8_t tmAddTask(void (*func)(void), uint32_t period_ms);
+int8_t tmAddTask_r(tmScheduler_t* s, void (*func)(void), uint32_t period_ms);
+
+#if TM_PRIORITIES
+/**
+ * @code{c}
+ * int8_t tmAddTaskPrio(
+ *                      void (*func)(void), 
+ *                      uint32_t period_ms,
+ *                      uint8_t priority
+ *                      );
+ * @endcode
+ *
+ * Adding a new task with a priority. When several tasks are ready at the
+ * same time, the one with the highest priority is started first. Tasks
+ * added with tmAddTask have priority 0.
+ *
+ * @param (*func)(void) procedure to add to the procedure startup list
+ *
+ * @param period_ms the start period of the procedure.
+ *
+ * @param priority the priority of the task, 0 is the lowest.
+ *
+ * @return The returned parameter is the sequential number of the task in the
+ * task list, or -1 if it was added unsuccessfully.
+ *
+ * Example usage:
+ * @code{c}
+ * void main {
+ *  tmAddTaskPrio(vTaskLogger, 10, 0);
+ *  tmAddTaskPrio(vTaskMotorControl, 10, 5);
+ * 
+ *  for ( ; ; ) {
+ *   tmUpdate();
+ *  }
+ * }
+ * @endcode
+ */
+int8_t tmAddTaskPrio(void (*func)(void), uint32_t period_ms, uint8_t priority);
+int8_t tmAddTaskPrio_r(tmScheduler_t* s, void (*func)(void), uint32_t period_ms, uint8_t priority);
+#endif // TM_PRIORITIES
+
+/**
+ * @code{c}
+ * int8_t tmUpdateTask(
+ *                     void (*func)(void), 
+ *                     uint32_t period_ms
+ *                     );
+ * @endcode
+ *
+ * Procedure for updating the task call time.
+ *
+ * @param (*func)(void) procedure to add to the procedure startup list
+ *
+ * @param period_ms the start period of the procedure.
+ *
+ * @return The returned parameter for a successful update is 0 or -1 for
+ * an unsuccessful addition.
+ *
+ * Example usage:
+ * @code{c}
+ * void vTaskLed( void );
+ *  led_blink();
+ * }
+ *
+ * void vTaskKey( void ) {
+ *  if (key_press) 
+ *   tmUpdateTask(vTaskLed, 200);
+ * }
+ *
+ * void main {
+ *  tmAddTask(vTaskKey, 100);
+ *  tmAddTask(vTaskLed, 500);
+ * 
+ *  for ( ; ; ) {
+ *   tmUpdate();
+ *  }
+ * }
+ * @endcode
+ */
+int8_t tmUpdateTask(void (*func)(void), uint32_t period_ms);
+int8_t tmUpdateTask_r(tmScheduler_t* s, void (*func)(void), uint32_t period_ms);
+
+
+/**
+ * @code{c}
+ * int8_t tmDeleteTask(
+ *                     void (*func)(void), 
+ *                     );
+ * @endcode
+ *
+ * Procedure for updating the task call time.
+ *
+ * @param (*func)(void) procedure to add to the procedure startup list
+ *
+ * @param period_ms the start period of the procedure.
+ *
+ * @return The returned parameter for a successful delete is 0 or -1 for
+ * an unsuccessful delete.
+ *
+ * Example usage:
+ * @code{c}
+ * void vTaskKey( void ) {
+ *  if (key_press) 
+ *   if (tmDeleteTask(vTaskKey) == 0)
+ *    printf("Procedure key scan deleted");
+ * }
+ *
+ * void main {
+ *  tmAddTask(vTaskKey, 100);
+ * 
+ *  for ( ; ; ) {
+ *   tmUpdate();
+ *  }
+ * }
+ * @endcode
+ */
+int8_t tmDeleteTask(void (*func)(void));
+int8_t tmDeleteTask_r(tmScheduler_t* s, void (*func)(void));
+
+/**
+ * @code{c}
+ * tmTaskHandle_t tmTaskCreate(
+ *                             void (*func)(void), 
+ *                             uint32_t period_ms
+ *                             );
+ * @endcode
+ *
+ * Adding a new task and getting its handle. Unlike tmUpdateTask and
+ * tmDeleteTask the handle functions find the task in O(1), and the same
+ * procedure can be added several times as independent tasks.
+ *
+ * @param (*func)(void) procedure to add to the procedure startup list
+ *
+ * @param period_ms the start period of the procedure.
+ *
+ * @return The handle of the task or TM_INVALID_HANDLE if it was added
+ * unsuccessfully.
+ *
+ * Example usage:
+ * @code{c}
+ * tmTaskHandle_t hLoop;
+ *
+ * void vTaskTune( void ) {
+ *  tmTaskSetPeriod(hLoop, calc_period());
+ * }
+ *
+ * void main {
+ *  hLoop = tmTaskCreate(vTaskLoop, 5);
+ *  tmTaskCreate(vTaskTune, 100);
+ * 
+ *  for ( ; ; ) {
+ *   tmUpdate();
+ *  }
+ * }
+ * @endcode
+ */
+tmTaskHandle_t tmTaskCreate(void (*func)(void), uint32_t period_ms);
+tmTaskHandle_t tmTaskCreate_r(tmScheduler_t* s, void (*func)(void), uint32_t period_ms);
+
+/**
+ * @brief Updating the period of the task by its handle, the countdown is
+ * restarted as in tmUpdateTask.
+ * 
+ * @param handle The handle returned by tmTaskCreate
+ * @param period_ms The new start period of the task
+ * @return 0 if the period is updated, -1 if the handle is stale
+ */
+int8_t tmTaskSetPeriod(tmTaskHandle_t handle, uint32_t period_ms);
+int8_t tmTaskSetPeriod_r(tmScheduler_t* s, tmTaskHandle_t handle, uint32_t period_ms);
+
+/**
+ * @brief The phase chosen automatically, see tmTaskCreatePhase
+ * 
+ */
+#define TM_PHASE_AUTO UINT32_MAX
+
+/**
+ * @code{c}
+ * tmTaskHandle_t tmTaskCreatePhase(
+ *                                  void (*func)(void), 
+ *                                  uint32_t period_ms,
+ *                                  uint32_t phase_ms
+ *                                  );
+ * @endcode
+ *
+ * Adding a new task with a phase offset. The task starts at
+ * phase_ms, phase_ms + period_ms, ... from now instead of period_ms,
+ * 2 * period_ms, ..., so tasks with the same or harmonic periods do not
+ * become ready in the same tick. The phase is taken modulo the period,
+ * 0 means a full period.
+ * With TM_PHASE_AUTO the phase is chosen so that the starts of the task
+ * are as far as possible from the starts of the tasks already added.
+ *
+ * @param (*func)(void) procedure to add to the procedure startup list
+ *
+ * @param period_ms the start period of the procedure.
+ *
+ * @param phase_ms the time to the first start or TM_PHASE_AUTO.
+ *
+ * @return The handle of the task or TM_INVALID_HANDLE if it was added
+ * unsuccessfully.
+ *
+ * Example usage:
+ * @code{c}
+ * void main {
+ *  // the sensors are polled in turn, every 2.5 ms one of them
+ *  tmTaskCreatePhase(vTaskSensor1, 10, 0);
+ *  tmTaskCreatePhase(vTaskSensor2, 10, TM_PHASE_AUTO);  // phase 5
+ *  tmTaskCreatePhase(vTaskSensor3, 10, TM_PHASE_AUTO);  // phase 2 or 3
+ *  tmTaskCreatePhase(vTaskSensor4, 10, TM_PHASE_AUTO);
+ * 
+ *  for ( ; ; ) {
+ *   tmUpdate();
+ *  }
+ * }
+ * @endcode
+ */
+tmTaskHandle_t tmTaskCreatePhase(void (*func)(void), uint32_t period_ms, uint32_t phase_ms);
+tmTaskHandle_t tmTaskCreatePhase_r(tmScheduler_t* s, void (*func)(void), uint32_t period_ms, uint32_t phase_ms);
+
+/**
+ * @brief Moving the starts of the task: the next start comes after
+ * phase_ms (modulo the period, 0 - a full period), then every period.
+ * 
+ * @param handle The handle returned by tmTaskCreate
+ * @param phase_ms The time to the next start or TM_PHASE_AUTO
+ * @return 0 if the phase is updated, -1 if the handle is stale
+ */
+int8_t tmTaskSetPhase(tmTaskHandle_t handle, uint32_t phase_ms);
+int8_t tmTaskSetPhase_r(tmScheduler_t* s, tmTaskHandle_t handle, uint32_t phase_ms);
+
+/**
+ * @brief Adding a new task with the period in microseconds, see
+ * tmTaskCreate. The period is rounded up to whole ticks of TM_TICK_US.
+ * 
+ * @param (*func)(void) procedure to add to the procedure startup list
+ * @param period_us the start period of the procedure in microseconds
+ * @return The handle of the task or TM_INVALID_HANDLE
+ */
+tmTaskHandle_t tmTaskCreate_us(void (*func)(void), uint32_t period_us);
+tmTaskHandle_t tmTaskCreate_us_r(tmScheduler_t* s, void (*func)(void), uint32_t period_us);
+
+/**
+ * @brief Updating the period of the task in microseconds, see
+ * tmTaskSetPeriod.
+ * 
+ * @param handle The handle returned by tmTaskCreate
+ * @param period_us The new start period of the task in microseconds
+ * @return 0 if the period is updated, -1 if the handle is stale
+ */
+int8_t tmTaskSetPeriod_us(tmTaskHandle_t handle, uint32_t period_us);
+int8_t tmTaskSetPeriod_us_r(tmScheduler_t* s, tmTaskHandle_t handle, uint32_t period_us);
+
+/**
+ * @brief Deleting the task by its handle. The handle becomes stale.
+ * 
+ * @param handle The handle returned by tmTaskCreate
+ * @return 0 if the task is deleted, -1 if the handle is stale
+ */
+int8_t tmTaskRemove(tmTaskHandle_t handle);
+int8_t tmTaskRemove_r(tmScheduler_t* s, tmTaskHandle_t handle);
+
+/**
+ * @code{c}
+ * int8_t tmTaskSetCatchup(
+ *                         tmTaskHandle_t handle, 
+ *                         uint8_t policy
+ *                         );
+ * @endcode
+ *
+ * Selecting what the task does after an overrun: TM_CATCHUP_SKIP (default),
+ * TM_CATCHUP_ONCE or TM_CATCHUP_BURST.
+ *
+ * @param handle The handle of the task
+ *
+ * @param policy The catch-up policy
+ *
+ * @return 0 if the policy is set, -1 if the handle is stale or the policy
+ * is unknown.
+ *
+ * Example usage:
+ * @code{c}
+ * void main {
+ *  tmTaskHandle_t hCount = tmTaskCreate(vTaskPulseCount, 1);
+ *  tmTaskSetCatchup(hCount, TM_CATCHUP_BURST);
+ * 
+ *  for ( ; ; ) {
+ *   tmUpdate();
+ *  }
+ * }
+ * @endcode
+ */
+int8_t tmTaskSetCatchup(tmTaskHandle_t handle, uint8_t policy);
+int8_t tmTaskSetCatchup_r(tmScheduler_t* s, tmTaskHandle_t handle, uint8_t policy);
+
+/**
+ * @brief Reading the overrun counter of the task: the number of starts that
+ * were released while the previous start had not been executed yet. A
+ * growing counter means the period of the task is too short for the real
+ * throughput of the main loop.
+ * 
+ * @param handle The handle of the task
+ * @param overruns The variable the counter is copied to
+ * @return 0 if the counter is read, -1 if the handle is stale
+ */
+int8_t tmTaskGetOverruns(tmTaskHandle_t handle, uint32_t* overruns);
+int8_t tmTaskGetOverruns_r(tmScheduler_t* s, tmTaskHandle_t handle, uint32_t* overruns);
+
+/**
+ * @brief Getting the handle of the first task with the given procedure,
+ * for example of a task added with tmAddTask.
+ * 
+ * @param (*func)(void) The procedure of the task
+ * @return The handle of the task or TM_INVALID_HANDLE if there is no such task
+ */
+tmTaskHandle_t tmTaskFind(void (*func)(void));
+tmTaskHandle_t tmTaskFind_r(tmScheduler_t* s, void (*func)(void));
+
+/**
+ * @brief Getting the handle of the task being executed
+ * 
+ * @return The handle of the task or TM_INVALID_HANDLE outside the tasks
+ */
+tmTaskHandle_t tmTaskSelf(void);
+
+#if TM_EVENTS
+/**
+ * @code{c}
+ * tmTaskHandle_t tmTaskCreateEvent(void (*func)(void));
+ * @endcode
+ *
+ * Adding an event-triggered task. The task has no period, it sleeps until
+ * tmSignal is called for it and is started by the next tmUpdate.
+ * The signals that come before the task is started are merged into one
+ * start, the task takes all the bits with tmEventsTake.
  *
  * @param (*func)(void) procedure to add to the procedure startup list
  *
- * @param period_ms the start period of the procedure.
- *
- * @return The returned parameter is the sequential number of the task in the
- * task list, or -1 if it was added unsuccessfully.
+ * @return The handle of the task or TM_INVALID_HANDLE if it was added
+ * unsuccessfully.
  *
  * Example usage:
  * @code{c}
- * void vTaskCount( void ) {
- *  static counter = 0;
- *  counter++;
+ * #define EV_RX    0x01
+ * #define EV_ERROR 0x02
+ *
+ * tmTaskHandle_t hUart;
+ *
+ * void USART1_IRQHandler(void) {
+ *  if (USART1->SR & USART_SR_RXNE) { rx_push(USART1->DR); tmSignal(hUart, EV_RX); }
+ *  if (USART1->SR & USART_SR_ORE) tmSignal(hUart, EV_ERROR);
  * }
  *
- * void vTaskLed( void ) {
- *  led_blink();
+ * void vTaskUart( void ) {
+ *  uint32_t ev = tmEventsTake();
+ *  if (ev & EV_RX) parse_rx();
+ *  if (ev & EV_ERROR) uart_recover();
  * }
  *
  * void main {
- *  tmAddTask(vTaskCount, 10);
- *  tmAddTask(vTaskLed, 500);
+ *  hUart = tmTaskCreateEvent(vTaskUart);
  * 
  *  for ( ; ; ) {
  *   tmUpdate();
@@ -81,40 +1038,68 @@ typedef struct {
  * }
  * @endcode
  */
+tmTaskHandle_t tmTaskCreateEvent(void (*func)(void));
+tmTaskHandle_t tmTaskCreateEvent_r(tmScheduler_t* s, void (*func)(void));
 
-int8_t tmAddTask(void (*func)(void), uint32_t period_ms);
+/**
+ * @brief Setting the event bits of the task and making it ready. It is
+ * safe to call from interrupts, any task can be signaled, a periodic one
+ * gets an extra start.
+ * 
+ * @param handle The handle of the task
+ * @param bits The event bits, OR-ed with the bits not taken yet
+ * @return 0 if the task is signaled, -1 if the handle is stale
+ */
+int8_t tmSignal(tmTaskHandle_t handle, uint32_t bits);
+int8_t tmSignal_r(tmScheduler_t* s, tmTaskHandle_t handle, uint32_t bits);
+
+/**
+ * @brief Taking and clearing the event bits of the task being executed
+ * 
+ * @return The bits signaled since the previous call
+ */
+uint32_t tmEventsTake(void);
+#endif // TM_EVENTS
 
+#if TM_COROUTINES
 /**
  * @code{c}
- * int8_t tmUpdateTask(
- *                     void (*func)(void), 
- *                     uint32_t period_ms
- *                     );
+ * tmTaskHandle_t tmTaskCreateCo(void (*func)(void));
  * @endcode
  *
- * Procedure for updating the task call time.
- *
- * @param (*func)(void) procedure to add to the procedure startup list
+ * Adding a coroutine task. Its procedure is written as a sequence with
+ * waits between TM_CO_BEGIN and TM_CO_END, every wait returns from the
+ * procedure and the next start continues after it. The task is started
+ * by the timing engine when its wait is over, not on every tmUpdate.
+ * The local variables are not kept across the waits, the state has to be
+ * static (one coroutine per procedure) or global. The switch of the
+ * coroutine takes the case labels of __LINE__, so the waits cannot be
+ * placed inside another switch and only one wait fits in a line.
+ * After TM_CO_END the task is deleted.
  *
- * @param period_ms the start period of the procedure.
+ * @param (*func)(void) procedure of the coroutine
  *
- * @return The returned parameter for a successful update is 0 or -1 for
- * an unsuccessful addition.
+ * @return The handle of the task or TM_INVALID_HANDLE if it was added
+ * unsuccessfully.
  *
  * Example usage:
  * @code{c}
- * void vTaskLed( void );
- *  led_blink();
- * }
- *
- * void vTaskKey( void ) {
- *  if (key_press) 
- *   tmUpdateTask(vTaskLed, 200);
+ * void vTaskInitModem( void ) {
+ *  static int i;
+ *  TM_CO_BEGIN();
+ *  modem_power_on();
+ *  TM_AWAIT_DELAY(500);
+ *  modem_send("AT\r");
+ *  TM_AWAIT_UNTIL(modem_reply_ready());
+ *  for (i = 0; i < 3; i++) {
+ *   modem_send_init(i);
+ *   TM_YIELD();
+ *  }
+ *  TM_CO_END();
  * }
  *
  * void main {
- *  tmAddTask(vTaskKey, 100);
- *  tmAddTask(vTaskLed, 500);
+ *  tmTaskCreateCo(vTaskInitModem);
  * 
  *  for ( ; ; ) {
  *   tmUpdate();
@@ -122,43 +1107,142 @@ int8_t tmAddTask(void (*func)(void), uint32_t period_ms);
  * }
  * @endcode
  */
-int8_t tmUpdateTask(void (*func)(void), uint32_t period_ms);
+tmTaskHandle_t tmTaskCreateCo(void (*func)(void));
+tmTaskHandle_t tmTaskCreateCo_r(tmScheduler_t* s, void (*func)(void));
+
+/**
+ * @brief The coroutine helpers used by the TM_ macros below, they work on
+ * the task being executed.
+ * tmCoLine - the point the coroutine resumes at, 0 - the start
+ * tmCoWait - storing the point and waking the task after the given ticks
+ * tmCoDue - whether the wait is over, the early starts return at once
+ * tmCoExit - deleting the finished coroutine task
+ * 
+ */
+uint16_t tmCoLine(void);
+void tmCoWait(uint16_t line, uint32_t ticks);
+bool tmCoDue(void);
+void tmCoExit(void);
+
+#if defined(__GNUC__) && __GNUC__ >= 7
+#define TM_CO_FALLTHROUGH __attribute__((fallthrough))
+#else
+#define TM_CO_FALLTHROUGH ((void)0)
+#endif
 
+#define TM_CO_BEGIN()   switch (tmCoLine()) { case 0:
+#define TM_CO_END()     } tmCoExit(); return
 
+/**
+ * @brief Waiting for the given number of milliseconds
+ * 
+ */
+#define TM_AWAIT_DELAY(ms)                                  \
+    do {                                                    \
+        tmCoWait(__LINE__, TM_MS_TO_TICKS(ms));             \
+        return;                                             \
+        case __LINE__:                                      \
+        if (!tmCoDue()) return;                             \
+    } while (0)
+
+/**
+ * @brief Waiting for the condition, it is checked once per tick
+ * 
+ */
+#define TM_AWAIT_UNTIL(cond)                                \
+    do {                                                    \
+        TM_CO_FALLTHROUGH;                                  \
+        case __LINE__:                                      \
+        if (!(cond)) {                                      \
+            tmCoWait(__LINE__, 1);                          \
+            return;                                         \
+        }                                                   \
+    } while (0)
+
+/**
+ * @brief Giving the way to the other tasks, the coroutine resumes on the
+ * next tick
+ * 
+ */
+#define TM_YIELD()  TM_AWAIT_DELAY(0)
+#endif // TM_COROUTINES
+
+#if TM_TASK_STATS
 /**
  * @code{c}
- * int8_t tmDeleteTask(
- *                     void (*func)(void), 
- *                     );
+ * int8_t tmTaskGetStats(
+ *                       tmTaskHandle_t handle, 
+ *                       TaskStats_s* stats
+ *                       );
  * @endcode
  *
- * Procedure for updating the task call time.
+ * Reading the execution time statistics of the task.
  *
- * @param (*func)(void) procedure to add to the procedure startup list
+ * @param handle The handle of the task
  *
- * @param period_ms the start period of the procedure.
+ * @param stats The structure the statistics are copied to
  *
- * @return The returned parameter for a successful delete is 0 or -1 for
- * an unsuccessful delete.
+ * @return 0 if the statistics are read, -1 if the handle is stale.
  *
  * Example usage:
  * @code{c}
- * void vTaskKey( void ) {
- *  if (key_press) 
- *   if (tmDeleteTask(vTaskKey) == 0)
- *    printf("Procedure key scan deleted");
- * }
- *
- * void main {
- *  tmAddTask(vTaskKey, 100);
- * 
- *  for ( ; ; ) {
- *   tmUpdate();
- *  }
+ * void vTaskReport( void ) {
+ *  TaskStats_s st;
+ *  if (tmTaskGetStats(tmTaskFind(vTaskControl), &st) == 0 && st.runs)
+ *   printf("control: avg %lu max %lu\n", (unsigned long)(st.total / st.runs), (unsigned long)st.max);
  * }
  * @endcode
  */
-int8_t tmDeleteTask(void (*func)(void));
+int8_t tmTaskGetStats(tmTaskHandle_t handle, TaskStats_s* stats);
+int8_t tmTaskGetStats_r(tmScheduler_t* s, tmTaskHandle_t handle, TaskStats_s* stats);
+
+/**
+ * @brief Clearing the execution time statistics of the task
+ * 
+ * @param handle The handle of the task
+ * @return 0 if the statistics are cleared, -1 if the handle is stale
+ */
+int8_t tmTaskResetStats(tmTaskHandle_t handle);
+int8_t tmTaskResetStats_r(tmScheduler_t* s, tmTaskHandle_t handle);
+#endif // TM_TASK_STATS
+
+#if TM_PRIORITIES
+/**
+ * @brief Changing the priority of the task by its handle
+ * 
+ * @param handle The handle returned by tmTaskCreate
+ * @param priority The new priority, 0 is the lowest
+ * @return 0 if the priority is changed, -1 if the handle is stale
+ */
+int8_t tmTaskSetPriority(tmTaskHandle_t handle, uint8_t priority);
+int8_t tmTaskSetPriority_r(tmScheduler_t* s, tmTaskHandle_t handle, uint8_t priority);
+#endif // TM_PRIORITIES
+
+#if TM_EDF
+/**
+ * @brief Setting the relative deadline of the task: every release must
+ * complete within deadline_ms. A deadline shorter than the period makes
+ * the task more urgent than the others of the same period.
+ * 
+ * @param handle The handle returned by tmTaskCreate
+ * @param deadline_ms The deadline after the release, 0 - the period
+ * (an event task is then due at once)
+ * @return 0 if the deadline is set, -1 if the handle is stale
+ */
+int8_t tmTaskSetDeadline(tmTaskHandle_t handle, uint32_t deadline_ms);
+int8_t tmTaskSetDeadline_r(tmScheduler_t* s, tmTaskHandle_t handle, uint32_t deadline_ms);
+
+/**
+ * @brief The number of the starts of the task that completed after their
+ * deadline
+ * 
+ * @param handle The handle returned by tmTaskCreate
+ * @param misses The place for the count
+ * @return 0 if the count is stored, -1 if the handle is stale
+ */
+int8_t tmTaskGetDeadlineMisses(tmTaskHandle_t handle, uint32_t* misses);
+int8_t tmTaskGetDeadlineMisses_r(tmScheduler_t* s, tmTaskHandle_t handle, uint32_t* misses);
+#endif // TM_EDF
 
 /**
  * @code{c}
@@ -168,11 +1252,14 @@ int8_t tmDeleteTask(void (*func)(void));
  * The tick processing procedure is called from the SysTick_Handler. 
  * You need to put the procedure in the SysTick_Handler in the stm32fxxx_it
  * file. Or create a timer with a 1 ms call and place a tmTick call in the 
- * timer's callback.
+ * timer's callback. The call period is TM_TICK_US (1 ms by default).
  * This task starts on an interrupt, so it doesn't start anything and doesn't
  * waste time. If timers are activated, they are started from this task, so 
  * there is no need to place code in the timers that delays the execution of 
- * the program. Activate the flags in the timers
+ * the program. Activate the flags in the timers. With TM_TIMER_DEFERRED the
+ * timer callbacks are only queued here and started from tmUpdate.
+ * With TM_ENGINE_WHEEL the tick only walks the tasks whose expiry falls into
+ * the current wheel bucket, so its time does not grow with MAX_TASKS.
  *
  * @param The parameters do not need to be transmitted.
  *
@@ -201,6 +1288,73 @@ int8_t tmDeleteTask(void (*func)(void));
  * @endcode
  */
 void tmTick(void);
+void tmTick_r(tmScheduler_t* s);
+
+#if TM_TICKLESS
+/**
+ * @brief The value of tmTicksToNextEvent when nothing is scheduled
+ * 
+ */
+#define TM_TICKS_INFINITE UINT32_MAX
+
+/**
+ * @code{c}
+ * void tmTickAdvance(
+ *                    uint32_t ticks
+ *                    );
+ * @endcode
+ *
+ * Catching up several passed ticks in one pass. The result is the same as
+ * calling tmTick the given number of times: every period boundary passed
+ * is counted as an activation, and tmUpdate handles them by the catch-up
+ * policy of the task. TM_CATCHUP_SKIP runs the task once and keeps its
+ * phase, TM_CATCHUP_ONCE runs it once and restarts its period, and
+ * TM_CATCHUP_BURST runs it once per passed boundary. It is called instead
+ * of tmTick, from the interrupt of the one-shot timer or with interrupts
+ * disabled.
+ *
+ * @param ticks The number of ticks passed since the previous call.
+ *
+ * @return The function returns nothing.
+ *
+ * Example usage:
+ * @code{c}
+ * void sIdleTickless(uint32_t ticks) {
+ *  uint32_t slept;
+ *  if (ticks > MAX_SLEEP_MS) ticks = MAX_SLEEP_MS;
+ *  slept = lptim_sleep_ms(ticks);
+ *  tmTickAdvance(slept);
+ * }
+ * @endcode
+ * A scheduler instance is served by the sIdleTickless_r hook, which gets
+ * the scheduler with nothing to do:
+ * @code{c}
+ * void sIdleTickless_r(tmScheduler_t* s, uint32_t ticks) {
+ *  tmTickAdvance_r(s, lptim_sleep_ms(ticks > MAX_SLEEP_MS ? MAX_SLEEP_MS : ticks));
+ * }
+ * @endcode
+ */
+void tmTickAdvance(uint32_t ticks);
+void tmTickAdvance_r(tmScheduler_t* s, uint32_t ticks);
+
+/**
+ * @code{c}
+ * uint32_t tmTicksToNextEvent(void);
+ * @endcode
+ *
+ * Calculating the number of ticks after which a task becomes ready or a
+ * timer expires. In tickless mode tmUpdate passes this value to the weak
+ * sIdleTickless(uint32_t ticks) hook when there is nothing to do, the hook
+ * can be redefined to sleep for the whole idle gap.
+ *
+ * @param The parameters do not need to be transmitted.
+ *
+ * @return 0 if a task is already ready, TM_TICKS_INFINITE if nothing is
+ * scheduled, otherwise the number of ticks to the next event.
+ */
+uint32_t tmTicksToNextEvent(void);
+uint32_t tmTicksToNextEvent_r(tmScheduler_t* s);
+#endif // TM_TICKLESS
 
 /**
  * @code{c}
@@ -210,7 +1364,10 @@ void tmTick(void);
  * All tasks are started from this function if their time has come to 
  * completion. If you don't need to do anything, sIdleTask starts. This 
  * way you can track the workload or execute other code while there are 
- * no tasks to complete.
+ * no tasks to complete. In tickless mode sIdleTickless is started instead,
+ * with the number of ticks to the next event. tmUpdate_r starts the
+ * sIdleTask_r(s) and sIdleTickless_r(s, ticks) hooks, by default they
+ * fall back to sIdleTask and, for the default scheduler, sIdleTickless.
  *
  * @param The parameters do not need to be transmitted.
  *
@@ -226,6 +1383,52 @@ void tmTick(void);
  * @endcode
  */
 void tmUpdate(void);
+void tmUpdate_r(tmScheduler_t* s);
+
+#if TM_HOST_EXECUTOR
+/**
+ * @code{c}
+ * int8_t tmExecutorStart(
+ *                        uint8_t threads
+ *                        );
+ * @endcode
+ *
+ * Starting the pool of worker threads. From now on tmUpdate only hands the
+ * ready tasks over to the workers, so independent tasks run in parallel and
+ * a slow task does not delay the others. A task that is still running when
+ * it becomes ready again is started after its previous run ends (with
+ * TM_ENGINE_HEAP without TM_PRIORITIES that start is skipped).
+ * The tasks run concurrently with tmUpdate and with each other, so only the
+ * tmUpdate thread may add, update or delete tasks.
+ *
+ * @param threads The number of worker threads, 1..TM_EXECUTOR_MAX_THREADS.
+ *
+ * @return 0 if the workers are started, -1 otherwise.
+ *
+ * Example usage:
+ * @code{c}
+ * int main(void) {
+ *  tmAddTask(vJobPoll, 100);
+ *  tmAddTask(vJobReport, 1000);
+ *  tmExecutorStart(4);
+ * 
+ *  for ( ; ; ) {
+ *   tmUpdate();
+ *  }
+ * }
+ * @endcode
+ */
+int8_t tmExecutorStart(uint8_t threads);
+int8_t tmExecutorStart_r(tmScheduler_t* s, uint8_t threads);
+
+/**
+ * @brief Stopping the worker threads. The already handed over tasks are
+ * completed, then tmUpdate starts the tasks itself again.
+ * 
+ */
+void tmExecutorStop(void);
+void tmExecutorStop_r(tmScheduler_t* s);
+#endif // TM_HOST_EXECUTOR
 
 /**
  * @code{c}
@@ -257,6 +1460,18 @@ void tmUpdate(void);
  * @endcode
  */
 bool tmDelay_ms(uint32_t* timestamp, uint32_t delay);
+bool tmDelay_ms_r(tmScheduler_t* s, uint32_t* timestamp, uint32_t delay);
+
+/**
+ * @brief Non-blocking delay in microseconds, see tmDelay_ms. The time
+ * advances by TM_TICK_US on each tick.
+ * 
+ * @param timestamp The variable in which the countdown will be stored
+ * @param delay The time delay in microseconds
+ * @return true if the time is up
+ */
+bool tmDelay_us(uint32_t* timestamp, uint32_t delay);
+bool tmDelay_us_r(tmScheduler_t* s, uint32_t* timestamp, uint32_t delay);
 
 #if MAX_TIMERS
 /**
@@ -301,6 +1516,79 @@ bool tmDelay_ms(uint32_t* timestamp, uint32_t delay);
  * @endcode
  */
 int8_t tmTimerStartOnce(uint32_t delay_ms, void (*func)(void));
+int8_t tmTimerStartOnce_r(tmScheduler_t* s, uint32_t delay_ms, void (*func)(void));
+
+/**
+ * @brief One-time timer start with the delay in microseconds, see
+ * tmTimerStartOnce. The delay is rounded up to whole ticks.
+ * 
+ * @param delay_us The time after which the procedure will start
+ * @param (*func)(void) A task that will be run once
+ * @return 0 if the timer is created or updated, -1 if there are no free timers
+ */
+int8_t tmTimerStartOnce_us(uint32_t delay_us, void (*func)(void));
+int8_t tmTimerStartOnce_us_r(tmScheduler_t* s, uint32_t delay_us, void (*func)(void));
+
+/**
+ * @brief The count of tmTimerStartPeriodic for a timer that runs until it
+ * is deleted
+ * 
+ */
+#define TM_TIMER_FOREVER 0
+
+/**
+ * @code{c}
+ * int8_t tmTimerStartPeriodic(
+ *                       uint32_t period_ms,
+ *                       uint16_t count,
+ *                       void (*func)(void)
+ *                       );
+ * @endcode
+ *
+ * Periodic timer start. The procedure is started every period_ms, the
+ * first time one period after the call, count times in total
+ * (TM_TIMER_FOREVER - until the timer is deleted). The timer reloads
+ * itself from its previous expiry, so the starts do not drift with the
+ * callback time and the callback does not need to restart it.
+ * Calling it again for the same procedure updates the period and the
+ * count, as tmTimerStartOnce does; tmTimerStartOnce turns it back into
+ * a one-shot timer.
+ *
+ * @param period_ms The time between the starts, at least one tick
+ * @param count The number of starts, TM_TIMER_FOREVER - unlimited
+ * @param (*func)(void) The procedure started by the timer
+ *
+ * @return 0 if the timer is created or updated, -1 if there are no free
+ * timers or the period is 0
+ *
+ * Example usage:
+ * @code{c}
+ * void vTimerBlink( void ) {
+ *  led_toggle();
+ * }
+ *
+ * void vTaskButton( void ) {
+ *  if (button_pressed()) {
+ *   // 5 blinks: 10 toggles 100 ms apart
+ *   tmTimerStartPeriodic(100, 10, vTimerBlink);
+ *  }
+ * }
+ * @endcode
+ */
+int8_t tmTimerStartPeriodic(uint32_t period_ms, uint16_t count, void (*func)(void));
+int8_t tmTimerStartPeriodic_r(tmScheduler_t* s, uint32_t period_ms, uint16_t count, void (*func)(void));
+
+/**
+ * @brief Periodic timer start with the period in microseconds, see
+ * tmTimerStartPeriodic. The period is rounded up to whole ticks.
+ * 
+ * @param period_us The time between the starts
+ * @param count The number of starts, TM_TIMER_FOREVER - unlimited
+ * @param (*func)(void) The procedure started by the timer
+ * @return 0 if the timer is created or updated, -1 if there are no free timers
+ */
+int8_t tmTimerStartPeriodic_us(uint32_t period_us, uint16_t count, void (*func)(void));
+int8_t tmTimerStartPeriodic_us_r(tmScheduler_t* s, uint32_t period_us, uint16_t count, void (*func)(void));
 
 /**
  * @code{c}
@@ -309,7 +1597,8 @@ int8_t tmTimerStartOnce(uint32_t delay_ms, void (*func)(void));
  *                       );
  * @endcode
  *
- * Removing a timer from the timer list.
+ * Removing a timer from the timer list. With TM_TIMER_DEFERRED the starts
+ * of the timer already queued by the tick are dropped as well.
  *
  *
  * @param (*func)(void) A task that will be run once
@@ -339,20 +1628,187 @@ int8_t tmTimerStartOnce(uint32_t delay_ms, void (*func)(void));
  * @endcode
  */
 int8_t tmTimerDelete(void (*func)(void));
+int8_t tmTimerDelete_r(tmScheduler_t* s, void (*func)(void));
 
 /**
  * @brief Internal timer processing function
  * 
  */
 void tmTimerProcess(void);
+void tmTimerProcess_r(tmScheduler_t* s);
 #endif // MAX_TIMERS
 
+#if TM_TIMER_NODES
+/**
+ * @brief Setting up an intrusive timer, once before it is started
+ * 
+ * @param t The timer
+ * @param callback The procedure started from tmUpdate when the timer
+ * expires, it may start the timer again
+ * @param arg The argument of the callback
+ */
+void tmTimerNodeInit(TimerNode_s* t, void (*callback)(void* arg), void* arg);
+
+/**
+ * @code{c}
+ * void tmTimerNodeStart(TimerNode_s* t, uint32_t delay_ms);
+ * bool tmTimerNodeCancel(TimerNode_s* t);
+ * @endcode
+ * 
+ * Starting the timer, or restarting it with a new delay if it is active,
+ * and cancelling it before it expires. The callback is started by the
+ * first tmUpdate after delay_ms (at least one tick). The timers are
+ * started and cancelled only from the tmUpdate thread: tasks, timer
+ * callbacks and the main loop, not from interrupts or executor workers.
+ * 
+ * @param t The timer
+ * @param delay_ms The time to the expiry
+ * @return tmTimerNodeCancel: true if the timer was active
+ * 
+ * Example usage:
+ * @code{c}
+ * typedef struct {
+ *  int fd;
+ *  TimerNode_s idle;
+ * } Conn_s;
+ * 
+ * static void onIdle(void* arg) {
+ *  conn_close(arg);
+ * }
+ * 
+ * void conn_open(Conn_s* c) {
+ *  tmTimerNodeInit(&c->idle, onIdle, c);
+ *  tmTimerNodeStart(&c->idle, 30000);
+ * }
+ * 
+ * void conn_on_data(Conn_s* c) {
+ *  tmTimerNodeStart(&c->idle, 30000);
+ * }
+ * 
+ * void conn_close(Conn_s* c) {
+ *  tmTimerNodeCancel(&c->idle);
+ *  close(c->fd);
+ * }
+ * @endcode
+ */
+void tmTimerNodeStart(TimerNode_s* t, uint32_t delay_ms);
+void tmTimerNodeStart_r(tmScheduler_t* s, TimerNode_s* t, uint32_t delay_ms);
+bool tmTimerNodeCancel(TimerNode_s* t);
+bool tmTimerNodeCancel_r(tmScheduler_t* s, TimerNode_s* t);
+
+/**
+ * @brief Starting the timer with the delay in microseconds, see
+ * tmTimerNodeStart. The delay is rounded up to whole ticks.
+ * 
+ * @param t The timer
+ * @param delay_us The time to the expiry
+ */
+void tmTimerNodeStart_us(TimerNode_s* t, uint32_t delay_us);
+void tmTimerNodeStart_us_r(tmScheduler_t* s, TimerNode_s* t, uint32_t delay_us);
+
+/**
+ * @code{c}
+ * void tmTimerNodeRestart(TimerNode_s* t, uint32_t delay_ms);
+ * @endcode
+ * 
+ * Restarting a timeout. If the timer is active and the new expiry is not
+ * earlier than the current one, only the new deadline is stored: the
+ * timer keeps its place in the heap and is moved when the old expiry
+ * comes due. A watchdog that is restarted on every packet and rarely
+ * fires costs one comparison and one store per restart. Otherwise it
+ * works as tmTimerNodeStart.
+ * 
+ * @param t The timer
+ * @param delay_ms The time to the expiry
+ * 
+ * Example usage:
+ * @code{c}
+ * static TimerNode_s linkTimeout;
+ * 
+ * static void onLinkLost(void* arg) {
+ *  link_down();
+ * }
+ * 
+ * void vTaskRx( void ) {
+ *  while (radio_receive(&packet)) {
+ *   tmTimerNodeRestart(&linkTimeout, 100);
+ *   handle(&packet);
+ *  }
+ * }
+ * 
+ * void main {
+ *  tmTimerNodeInit(&linkTimeout, onLinkLost, 0);
+ *  tmAddTask(vTaskRx, 1);
+ * 
+ *  for ( ; ; ) {
+ *   tmUpdate();
+ *  }
+ * }
+ * @endcode
+ */
+void tmTimerNodeRestart(TimerNode_s* t, uint32_t delay_ms);
+void tmTimerNodeRestart_r(tmScheduler_t* s, TimerNode_s* t, uint32_t delay_ms);
+void tmTimerNodeRestart_us(TimerNode_s* t, uint32_t delay_us);
+void tmTimerNodeRestart_us_r(tmScheduler_t* s, TimerNode_s* t, uint32_t delay_us);
+
+/**
+ * @brief Checking whether the timer is started and has not expired yet
+ * 
+ * @param t The timer
+ * @return bool
+ */
+bool tmTimerNodeActive(const TimerNode_s* t);
+#endif // TM_TIMER_NODES
+
 /**
  * @brief Taking the current millisecond parmeter
+ * With TM_TICK_US other than 1000 it is calculated from the ticks and
+ * jumps when the 32-bit tick counter wraps, unless TM_TIME64 is used.
  * 
  * @return uint32_t 
  */
 uint32_t get_millis (void);
+uint32_t get_millis_r(tmScheduler_t* s);
+
+/**
+ * @brief Taking the number of ticks passed, the time base of the tasks,
+ * timers and tmTicksToNextEvent
+ * 
+ * @return uint32_t 
+ */
+uint32_t get_ticks(void);
+uint32_t get_ticks_r(tmScheduler_t* s);
+
+/**
+ * @brief Taking the current microsecond parameter, it advances by
+ * TM_TICK_US on each tick and wraps after 71 minutes.
+ * 
+ * @return uint32_t 
+ */
+uint32_t get_micros(void);
+uint32_t get_micros_r(tmScheduler_t* s);
+
+#if TM_TIME64
+/**
+ * @brief Taking the current millisecond parameter as a 64-bit value that
+ * does not wrap. It is safe to call from any context, also from an
+ * interrupt that preempts the tick: the reading never waits for the tick.
+ * 
+ * @return uint64_t 
+ */
+uint64_t get_millis64(void);
+uint64_t get_millis64_r(tmScheduler_t* s);
+
+/**
+ * @brief Non-blocking delay with a 64-bit time stamp, see tmDelay_ms
+ * 
+ * @param timestamp The variable in which the countdown will be stored
+ * @param delay The time delay after which the trigger is required
+ * @return true if the time is up
+ */
+bool tmDelay64_ms(uint64_t* timestamp, uint32_t delay);
+bool tmDelay64_ms_r(tmScheduler_t* s, uint64_t* timestamp, uint32_t delay);
+#endif // TM_TIME64
 
 
 
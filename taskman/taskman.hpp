@@ -0,0 +1,332 @@
+#ifndef INC_TASKMAN_HPP_
+#define INC_TASKMAN_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/**
+ * @brief Header-only C++17 version of the scheduler. The capacity is a
+ * template parameter, so schedulers of different sizes live side by side
+ * in one program, and the tasks are any callables (lambdas, functors,
+ * member functions) stored inside the scheduler without heap allocation.
+ * The tasks of one scheduler have different types, so update() starts each
+ * one with an indirect call through a thunk made for its callable; the
+ * body is inlined into the thunk, not into update().
+ * The tasks and timers are compared with Clock::now() in update(), the
+ * missed starts are skipped as with TM_CATCHUP_SKIP of the C version.
+ * The namespace is taskman, tm would clash with struct tm of <ctime>.
+ * 
+ */
+namespace taskman {
+
+/**
+ * @brief Default clock: a tick counter advanced by tick() from the tick
+ * interrupt. A custom clock only needs a static now() returning the ticks
+ * as uint32_t.
+ * 
+ */
+struct TickClock {
+    static uint32_t now() { return count; }
+    static void tick() { count = count + 1; }
+
+private:
+    static inline volatile uint32_t count = 0;
+};
+
+/**
+ * @brief A callable kept in a fixed buffer of Size bytes
+ * 
+ */
+template <std::size_t Size>
+class Callable {
+public:
+    Callable() = default;
+    Callable(const Callable&) = delete;
+    Callable& operator=(const Callable&) = delete;
+    ~Callable() { reset(); }
+
+    template <class F>
+    void emplace(F&& f) {
+        using Fn = std::decay_t<F>;
+        static_assert(sizeof(Fn) <= Size, "the callable does not fit, increase CallableSize");
+        static_assert(alignof(Fn) <= alignof(std::max_align_t), "the callable is over-aligned");
+        reset();
+        ::new (static_cast<void*>(buf)) Fn(std::forward<F>(f));
+        call = [](void* p) { (*static_cast<Fn*>(p))(); };
+        if constexpr (std::is_trivially_destructible_v<Fn>) {
+            destroy = nullptr;
+        } else {
+            destroy = [](void* p) { static_cast<Fn*>(p)->~Fn(); };
+        }
+    }
+
+    void reset() {
+        if (destroy) destroy(buf);
+        call = nullptr;
+        destroy = nullptr;
+    }
+
+    void operator()() { call(buf); }
+    explicit operator bool() const { return call != nullptr; }
+
+private:
+    alignas(std::max_align_t) unsigned char buf[Size];
+    void (*call)(void*) = nullptr;
+    void (*destroy)(void*) = nullptr;
+};
+
+/**
+ * @code{cpp}
+ * template <std::size_t NTasks, std::size_t NTimers, class Clock, std::size_t CallableSize>
+ * class Scheduler;
+ * @endcode
+ * 
+ * Scheduler of NTasks periodic tasks and NTimers one-shot timers, the
+ * times are in ticks of Clock. CallableSize is the room for one callable
+ * (its captures), two pointers by default.
+ * 
+ * Example usage:
+ * @code{cpp}
+ * struct Led {
+ *  void toggle();
+ * } led;
+ * 
+ * taskman::Scheduler<4, 2> fast;
+ * taskman::Scheduler<16> slow;
+ * 
+ * extern "C" void SysTick_Handler(void) {
+ *  taskman::TickClock::tick();
+ * }
+ * 
+ * int main() {
+ *  int samples = 0;
+ *  fast.add([&samples] { samples++; }, 1);
+ *  fast.add<&Led::toggle>(led, 500);
+ *  slow.add([] { report(); }, 1000);
+ *  fast.startOnce([] { led_off(); }, 20);
+ * 
+ *  for ( ; ; ) {
+ *   fast.update();
+ *   slow.update();
+ *  }
+ * }
+ * @endcode
+ */
+template <std::size_t NTasks, std::size_t NTimers = 0, class Clock = TickClock,
+          std::size_t CallableSize = 2 * sizeof(void*)>
+class Scheduler {
+    static_assert(NTasks > 0 && NTasks <= 255, "NTasks must be 1..255");
+    static_assert(NTimers <= 255, "NTimers must be 0..255");
+
+public:
+    // Task and timer handle: the slot number in the low byte and the
+    // generation of the slot in the high byte, 0 - no task
+    using Handle = uint16_t;
+    static constexpr Handle invalid = 0;
+
+    Scheduler() = default;
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+
+    /**
+     * @brief Adding a task started every period ticks, the first start
+     * comes after phase ticks (0 - a full period)
+     * 
+     * @return The handle of the task or invalid if there are no free slots
+     */
+    template <class F>
+    Handle add(F&& f, uint32_t period, uint32_t phase = 0) {
+        for (std::size_t i = 0; i < NTasks; i++) {
+            Task& t = tasks[i];
+            if (t.fn) continue;
+            t.fn.emplace(std::forward<F>(f));
+            if (++t.gen == 0) t.gen = 1;
+            arm(t, period, phase);
+            return handle(i, t.gen);
+        }
+        return invalid;
+    }
+
+    /**
+     * @brief Adding a task that calls a member function of the object
+     * 
+     */
+    template <auto Method, class T>
+    Handle add(T& obj, uint32_t period, uint32_t phase = 0) {
+        return add([&obj] { (obj.*Method)(); }, period, phase);
+    }
+
+    /**
+     * @brief Updating the period of the task, the countdown is restarted
+     * 
+     * @return false if the handle is stale
+     */
+    bool setPeriod(Handle h, uint32_t period, uint32_t phase = 0) {
+        Task* t = find(h);
+        if (!t) return false;
+        arm(*t, period, phase);
+        return true;
+    }
+
+    /**
+     * @brief Deleting the task, the handle becomes stale at once. A task can
+     * delete itself, its callable is destroyed after it returns.
+     * 
+     * @return false if the handle is stale
+     */
+    bool remove(Handle h) {
+        Task* t = find(h);
+        if (!t) return false;
+        t->period = 0;
+        if (++t->gen == 0) t->gen = 1;
+        if (t == running) {
+            removeRunning = true;
+        } else {
+            t->fn.reset();
+        }
+        return true;
+    }
+
+    /**
+     * @brief Starting a one-shot timer, the callable is started from
+     * update() once the delay has passed
+     * 
+     * @return The handle of the timer or invalid if there are no free timers
+     */
+    template <class F>
+    Handle startOnce(F&& f, uint32_t delay) {
+        static_assert(NTimers > 0, "the scheduler has no timers");
+        for (std::size_t i = 0; i < NTimers; i++) {
+            Timer& t = timers[i];
+            if (t.fn) continue;
+            t.fn.emplace(std::forward<F>(f));
+            if (++t.gen == 0) t.gen = 1;
+            t.deadline = Clock::now() + delay;
+            return handle(i, t.gen);
+        }
+        return invalid;
+    }
+
+    /**
+     * @brief Cancelling the timer that has not fired yet
+     * 
+     * @return false if the handle is stale or the timer has fired
+     */
+    bool cancel(Handle h) {
+        std::size_t i = h & 0xFF;
+        if (i >= NTimers || !timers[i].fn || timers[i].gen != (h >> 8)) return false;
+        if (&timers[i] == firing) return false;
+        timers[i].fn.reset();
+        return true;
+    }
+
+    /**
+     * @brief Starting the due tasks and timers, to be called in the main loop
+     * 
+     * @return true if anything was started
+     */
+    bool update() {
+        uint32_t now = Clock::now();
+        bool executed = false;
+        for (Task& t : tasks) {
+            if (!t.period || !due(now, t.release)) continue;
+            // the release moves to the first period boundary after now
+            uint32_t late = now - t.release;
+            t.release += (late / t.period + 1) * t.period;
+            running = &t;
+            t.fn();
+            running = nullptr;
+            if (removeRunning) {
+                removeRunning = false;
+                t.fn.reset();
+            }
+            executed = true;
+        }
+        for (Timer& t : timers) {
+            if (!t.fn || !due(now, t.deadline)) continue;
+            // the slot stays taken while the callable runs and is freed after it
+            firing = &t;
+            t.fn();
+            firing = nullptr;
+            t.fn.reset();
+            executed = true;
+        }
+        return executed;
+    }
+
+    /**
+     * @brief The ticks to the nearest task or timer start, 0 - something is
+     * due, UINT32_MAX - nothing is scheduled
+     * 
+     */
+    uint32_t ticksToNextEvent() const {
+        uint32_t now = Clock::now();
+        uint32_t next = UINT32_MAX;
+        for (const Task& t : tasks) {
+            if (t.period) next = nearest(next, now, t.release);
+        }
+        for (const Timer& t : timers) {
+            if (t.fn) next = nearest(next, now, t.deadline);
+        }
+        return next;
+    }
+
+    static constexpr std::size_t capacity() { return NTasks; }
+
+private:
+    struct Task {
+        Callable<CallableSize> fn;
+        uint32_t period = 0;    // in ticks, 0 - stopped
+        uint32_t release = 0;   // absolute tick of the next start
+        uint8_t gen = 0;
+    };
+
+    struct Timer {
+        Callable<CallableSize> fn;
+        uint32_t deadline = 0;
+        uint8_t gen = 0;
+    };
+
+    static Handle handle(std::size_t i, uint8_t gen) {
+        return static_cast<Handle>(gen << 8 | i);
+    }
+
+    // The comparison survives the overflow of the clock
+    static bool due(uint32_t now, uint32_t at) {
+        return static_cast<int32_t>(now - at) >= 0;
+    }
+
+    static uint32_t nearest(uint32_t next, uint32_t now, uint32_t at) {
+        int32_t left = static_cast<int32_t>(at - now);
+        uint32_t ticks = left > 0 ? static_cast<uint32_t>(left) : 0;
+        return ticks < next ? ticks : next;
+    }
+
+    void arm(Task& t, uint32_t period, uint32_t phase) {
+        t.period = period;
+        if (period) {
+            phase %= period;
+            t.release = Clock::now() + (phase ? phase : period);
+        }
+    }
+
+    Task* find(Handle h) {
+        std::size_t i = h & 0xFF;
+        if (i >= NTasks || !tasks[i].fn || tasks[i].gen != (h >> 8)) return nullptr;
+        return &tasks[i];
+    }
+
+    Task tasks[NTasks];
+    // zero-length arrays are not allowed, an unused timer takes its place
+    Timer timers[NTimers ? NTimers : 1];
+    Task* running = nullptr;
+    Timer* firing = nullptr;
+    bool removeRunning = false;
+};
+
+} // namespace taskman
+
+#endif // INC_TASKMAN_HPP_
@@ -0,0 +1,78 @@
+#include "taskman_queue.h"
+#include "string.h"
+
+int8_t tmQueueInit(MsgQueue_s* q, void* buf, uint16_t itemSize, uint16_t capacity) {
+    if (!capacity || (capacity & (capacity - 1)) || capacity > 32768) return -1;
+    q->buf = buf;
+    q->itemSize = itemSize;
+    q->mask = capacity - 1;
+    q->head = 0;
+    q->tail = 0;
+#if TM_EVENTS
+    q->sched = &tmSchedulerDefault;
+    q->consumer = TM_INVALID_HANDLE;
+    q->bits = 0;
+#endif
+    return 0;
+}
+
+#if TM_EVENTS
+void tmQueueSetConsumer(MsgQueue_s* q, tmTaskHandle_t consumer, uint32_t bits) {
+    tmQueueSetConsumer_r(q, &tmSchedulerDefault, consumer, bits);
+}
+
+void tmQueueSetConsumer_r(MsgQueue_s* q, tmScheduler_t* s, tmTaskHandle_t consumer, uint32_t bits) {
+    q->sched = s;
+    q->bits = bits;
+    q->consumer = consumer;
+}
+#endif // TM_EVENTS
+
+/*
+ * The head and the tail run freely, their difference is the number of the
+ * messages even after the 16-bit overflow
+ */
+void* tmQueueReserve(MsgQueue_s* q) {
+    uint16_t head = q->head;
+    if ((uint16_t)(head - __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE)) > q->mask) return 0;
+    return q->buf + (uint32_t)(head & q->mask) * q->itemSize;
+}
+
+void tmQueueCommit(MsgQueue_s* q) {
+    // the message is written before the consumer sees the new head
+    __atomic_store_n(&q->head, (uint16_t)(q->head + 1), __ATOMIC_RELEASE);
+#if TM_EVENTS
+    if (q->consumer != TM_INVALID_HANDLE) tmSignal_r(q->sched, q->consumer, q->bits);
+#endif
+}
+
+void* tmQueuePeek(MsgQueue_s* q) {
+    uint16_t tail = q->tail;
+    if (tail == __atomic_load_n(&q->head, __ATOMIC_ACQUIRE)) return 0;
+    return q->buf + (uint32_t)(tail & q->mask) * q->itemSize;
+}
+
+void tmQueueRelease(MsgQueue_s* q) {
+    // the message is read before the producer can reuse its place
+    __atomic_store_n(&q->tail, (uint16_t)(q->tail + 1), __ATOMIC_RELEASE);
+}
+
+bool tmQueuePush(MsgQueue_s* q, const void* item) {
+    void* place = tmQueueReserve(q);
+    if (!place) return false;
+    memcpy(place, item, q->itemSize);
+    tmQueueCommit(q);
+    return true;
+}
+
+bool tmQueuePop(MsgQueue_s* q, void* item) {
+    void* place = tmQueuePeek(q);
+    if (!place) return false;
+    memcpy(item, place, q->itemSize);
+    tmQueueRelease(q);
+    return true;
+}
+
+uint16_t tmQueueCount(const MsgQueue_s* q) {
+    return (uint16_t)(__atomic_load_n(&q->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE));
+}
@@ -0,0 +1,152 @@
+#ifndef INC_TASKMAN_QUEUE_H_
+#define INC_TASKMAN_QUEUE_H_
+
+#include "taskman.h"
+
+/**
+ * @brief Single-producer/single-consumer message queue. The producer only
+ * moves the head and the consumer only moves the tail, so an interrupt and
+ * a task (or two tasks) exchange messages without locks. The messages are
+ * written and read in place in the buffer of the queue.
+ * 
+ */
+typedef struct {
+    uint8_t* buf;
+    uint16_t itemSize;
+    uint16_t mask;              // capacity - 1, the capacity is a power of two
+    volatile uint16_t head;     // messages committed, moved by the producer
+    volatile uint16_t tail;     // messages released, moved by the consumer
+#if TM_EVENTS
+    tmScheduler_t* sched;       // the scheduler of the consumer task
+    tmTaskHandle_t consumer;    // task signaled on commit, TM_INVALID_HANDLE - none
+    uint32_t bits;
+#endif
+} MsgQueue_s;
+
+/**
+ * @brief Defining a queue with a static buffer for capacity messages of
+ * the given type. The capacity must be a power of two, 32768 at most.
+ * 
+ */
+#define TM_QUEUE_DEFINE(name, type, capacity)                                                       \
+    static type name##Buf[(capacity) & ((capacity) - 1) ? -1 : (capacity)];                          \
+    MsgQueue_s name = { .buf = (uint8_t*)name##Buf, .itemSize = sizeof(type), .mask = (capacity) - 1 }
+
+/**
+ * @brief Initializing a queue in the given buffer
+ * 
+ * @param q The queue
+ * @param buf The buffer of capacity * itemSize bytes
+ * @param itemSize The size of a message
+ * @param capacity The number of messages, a power of two up to 32768
+ * @return 0 if the queue is initialized, -1 if the capacity is wrong
+ */
+int8_t tmQueueInit(MsgQueue_s* q, void* buf, uint16_t itemSize, uint16_t capacity);
+
+#if TM_EVENTS
+/**
+ * @brief Setting the task that is signaled with the given event bits on
+ * every commit, so it handles the data as soon as it arrives. The task is
+ * usually created with tmTaskCreateEvent. The _r variant takes the
+ * scheduler of the task, the other one uses the default scheduler.
+ * 
+ * @param q The queue
+ * @param s The scheduler of the consumer task
+ * @param consumer The consumer task, TM_INVALID_HANDLE - none
+ * @param bits The event bits passed to tmSignal
+ */
+void tmQueueSetConsumer(MsgQueue_s* q, tmTaskHandle_t consumer, uint32_t bits);
+void tmQueueSetConsumer_r(MsgQueue_s* q, tmScheduler_t* s, tmTaskHandle_t consumer, uint32_t bits);
+#endif // TM_EVENTS
+
+/**
+ * @code{c}
+ * void* tmQueueReserve(MsgQueue_s* q);
+ * void tmQueueCommit(MsgQueue_s* q);
+ * @endcode
+ * 
+ * Producer side. tmQueueReserve gives the place of the next message in the
+ * buffer, the producer writes the message there and publishes it with
+ * tmQueueCommit. The commit wakes the consumer task if it is set.
+ * 
+ * @param q The queue
+ * 
+ * @return The place of the message or 0 if the queue is full.
+ * 
+ * Example usage:
+ * @code{c}
+ * typedef struct { uint16_t ch[4]; } Sample_s;
+ * TM_QUEUE_DEFINE(adcQueue, Sample_s, 16);
+ * 
+ * void DMA1_Channel1_IRQHandler(void) {
+ *  Sample_s* s = tmQueueReserve(&adcQueue);
+ *  if (s) {
+ *   memcpy(s->ch, adc_dma_buf, sizeof(s->ch));
+ *   tmQueueCommit(&adcQueue);
+ *  }
+ * }
+ * 
+ * void vTaskFilter( void ) {
+ *  Sample_s* s;
+ *  while ((s = tmQueuePeek(&adcQueue)) != 0) {
+ *   filter_put(s);
+ *   tmQueueRelease(&adcQueue);
+ *  }
+ * }
+ * 
+ * void main {
+ *  tmQueueSetConsumer(&adcQueue, tmTaskCreateEvent(vTaskFilter), 1);
+ * 
+ *  for ( ; ; ) {
+ *   tmUpdate();
+ *  }
+ * }
+ * @endcode
+ */
+void* tmQueueReserve(MsgQueue_s* q);
+void tmQueueCommit(MsgQueue_s* q);
+
+/**
+ * @brief Consumer side: the oldest message in place, released with
+ * tmQueueRelease after it is handled.
+ * 
+ * @param q The queue
+ * @return The oldest message or 0 if the queue is empty
+ */
+void* tmQueuePeek(MsgQueue_s* q);
+
+/**
+ * @brief Freeing the message taken with tmQueuePeek
+ * 
+ * @param q The queue
+ */
+void tmQueueRelease(MsgQueue_s* q);
+
+/**
+ * @brief Copying a message into the queue, reserve and commit in one call
+ * 
+ * @param q The queue
+ * @param item The message
+ * @return true if the message is queued, false if the queue is full
+ */
+bool tmQueuePush(MsgQueue_s* q, const void* item);
+
+/**
+ * @brief Copying the oldest message out of the queue, peek and release in
+ * one call
+ * 
+ * @param q The queue
+ * @param item The place for the message
+ * @return true if a message is taken, false if the queue is empty
+ */
+bool tmQueuePop(MsgQueue_s* q, void* item);
+
+/**
+ * @brief The number of the messages in the queue
+ * 
+ * @param q The queue
+ * @return uint16_t
+ */
+uint16_t tmQueueCount(const MsgQueue_s* q);
+
+#endif // INC_TASKMAN_QUEUE_H_
@@ -0,0 +1,87 @@
+#include "taskman_sim.h"
+
+#if TM_SIM
+
+static void (*simTrace)(uint32_t time, tmTaskHandle_t task);
+
+// Recording of the task starts
+static SimEvent_s*          simRecord;
+static uint32_t             simRecordCapacity;
+static uint32_t             simRecordCount;
+
+// Checking of the task starts against a recording
+static const SimEvent_s*    simReplay;
+static uint32_t             simReplayCount;
+static uint32_t             simReplayPos;
+static int32_t              simReplayError = -1;
+
+/*
+ * Starting everything that is ready at the current virtual time
+ */
+static void sSimDrain(void) {
+    while (tmTicksToNextEvent() == 0) tmUpdate();
+}
+
+void tmSimRun(uint32_t ticks) {
+    uint32_t end = get_ticks() + ticks;
+    for ( ; ; ) {
+        uint32_t left, next;
+        sSimDrain();
+        left = end - get_ticks();
+        if (left == 0 || left > ticks) break;
+        // jumping straight to the next event, or to the end of the run
+        next = tmTicksToNextEvent();
+        tmTickAdvance(next < left ? next : left);
+    }
+}
+
+void tmSimConsume(uint32_t ticks) {
+    tmTickAdvance(ticks);
+}
+
+void tmSimSetTrace(void (*trace)(uint32_t time, tmTaskHandle_t task)) {
+    simTrace = trace;
+}
+
+void tmSimRecord(SimEvent_s* events, uint32_t capacity) {
+    simRecord = events;
+    simRecordCapacity = events ? capacity : 0;
+    simRecordCount = 0;
+}
+
+uint32_t tmSimRecorded(void) {
+    return simRecordCount;
+}
+
+void tmSimReplay(const SimEvent_s* events, uint32_t count) {
+    simReplay = events;
+    simReplayCount = count;
+    simReplayPos = 0;
+    simReplayError = -1;
+}
+
+int32_t tmSimReplayResult(void) {
+    if (simReplayError < 0 && simReplayPos < simReplayCount) return simReplayPos;
+    return simReplayError;
+}
+
+void tmSimOnDispatch(tmTaskHandle_t task) {
+    uint32_t now = get_ticks();
+    if (simTrace) simTrace(now, task);
+    if (simRecordCount < simRecordCapacity) {
+        simRecord[simRecordCount].time = now;
+        simRecord[simRecordCount].task = task;
+        simRecordCount++;
+    }
+    if (simReplay && simReplayError < 0) {
+        if (simReplayPos >= simReplayCount
+            || simReplay[simReplayPos].time != now
+            || simReplay[simReplayPos].task != task) {
+            simReplayError = simReplayPos;
+        } else {
+            simReplayPos++;
+        }
+    }
+}
+
+#endif // TM_SIM
@@ -0,0 +1,143 @@
+#ifndef INC_TASKMAN_SIM_H_
+#define INC_TASKMAN_SIM_H_
+
+#include "taskman.h"
+
+#if TM_SIM
+/**
+ * @brief A recorded task start: the virtual time and the task handle
+ * 
+ */
+typedef struct {
+    uint32_t time;
+    tmTaskHandle_t task;
+} SimEvent_s;
+
+/**
+ * @code{c}
+ * void tmSimRun(
+ *               uint32_t ticks
+ *               );
+ * @endcode
+ *
+ * Running the scheduler for the given number of ticks of virtual time. The
+ * time jumps straight to the next task or timer event with tmTickAdvance,
+ * in between tmUpdate is called until nothing is ready. The tasks take no
+ * virtual time unless they call tmSimConsume. Hours of device operation
+ * are simulated in a fraction of a second, and with the same task set the
+ * schedule is the same on every run.
+ *
+ * @param ticks The virtual time to simulate.
+ *
+ * @return The function returns nothing.
+ *
+ * Example usage:
+ * @code{c}
+ * int main(void) {
+ *  tmAddTask(vTaskSensor, 10);
+ *  tmAddTask(vTaskReport, 1000);
+ *  tmSimRun(3600UL * 1000);  // one hour
+ * }
+ * @endcode
+ */
+void tmSimRun(uint32_t ticks);
+
+/**
+ * @brief Spending virtual time inside a task, as if its code ran for the
+ * given number of ticks. The tasks and timers that become due meanwhile are
+ * released as they would be by the tick interrupt.
+ * 
+ * @param ticks The execution time of the task
+ */
+void tmSimConsume(uint32_t ticks);
+
+/**
+ * @brief Setting a procedure that is called before every task start with
+ * the virtual time and the task handle, 0 - no tracing.
+ * 
+ * @param trace The trace procedure
+ */
+void tmSimSetTrace(void (*trace)(uint32_t time, tmTaskHandle_t task));
+
+/**
+ * @code{c}
+ * void tmSimRecord(
+ *                  SimEvent_s* events,
+ *                  uint32_t capacity
+ *                  );
+ * @endcode
+ *
+ * Recording the task starts into the array. The recording stops silently
+ * when the array is full, tmSimRecorded returns the number of the events.
+ *
+ * @param events The array for the events, 0 - stop recording.
+ *
+ * @param capacity The size of the array.
+ *
+ * @return The function returns nothing.
+ */
+void tmSimRecord(SimEvent_s* events, uint32_t capacity);
+
+/**
+ * @brief The number of the events recorded since tmSimRecord
+ * 
+ * @return uint32_t 
+ */
+uint32_t tmSimRecorded(void);
+
+/**
+ * @code{c}
+ * void tmSimReplay(
+ *                  const SimEvent_s* events,
+ *                  uint32_t count
+ *                  );
+ * @endcode
+ *
+ * Checking the following task starts against a recorded schedule. Every
+ * start is compared with the next recorded event, tmSimReplayResult
+ * reports the first difference.
+ *
+ * @param events The recorded events.
+ *
+ * @param count The number of the recorded events.
+ *
+ * @return The function returns nothing.
+ *
+ * Example usage:
+ * @code{c}
+ * static SimEvent_s golden[10000];
+ *
+ * int main(int argc, char** argv) {
+ *  setup_tasks();
+ *  if (argc > 1 && strcmp(argv[1], "record") == 0) {
+ *   tmSimRecord(golden, 10000);
+ *   tmSimRun(60000);
+ *   save_events("golden.bin", golden, tmSimRecorded());
+ *   return 0;
+ *  }
+ *  tmSimReplay(golden, load_events("golden.bin", golden, 10000));
+ *  tmSimRun(60000);
+ *  return tmSimReplayResult() == -1 ? 0 : 1;
+ * }
+ * @endcode
+ */
+void tmSimReplay(const SimEvent_s* events, uint32_t count);
+
+/**
+ * @brief The result of the replay check
+ * 
+ * @return -1 if all the task starts matched the recording (and all the
+ * recorded events were reached), otherwise the index of the first
+ * event that differs
+ */
+int32_t tmSimReplayResult(void);
+
+/**
+ * @brief Internal dispatch hook, called by the scheduler before every
+ * task start
+ * 
+ */
+void tmSimOnDispatch(tmTaskHandle_t task);
+#endif // TM_SIM
+
+#endif // INC_TASKMAN_SIM_H_
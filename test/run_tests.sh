@@ -0,0 +1,20 @@
+#!/bin/sh
+# Builds tm_test for every engine and timer mode and runs it.
+# Usage: ./run_tests.sh [extra compiler flags]
+set -e
+cd "$(dirname "$0")"
+CC=${CC:-cc}
+OUT=$(mktemp -d)
+trap 'rm -rf "$OUT"' EXIT
+
+for engine in TM_ENGINE_COUNTDOWN TM_ENGINE_WHEEL TM_ENGINE_HEAP; do
+    for deferred in 0 1; do
+        for tickless in 0 1; do
+            flags="-DTM_ENGINE=$engine -DTM_TIMER_DEFERRED=$deferred -DTM_TICKLESS=$tickless"
+            "$CC" -O2 -Wall -Wextra -I../taskman $flags "$@" \
+                tm_test.c ../taskman/taskman.c -o "$OUT/tm_test"
+            "$OUT/tm_test" || { echo "tm_test failed: $flags $*"; exit 1; }
+        done
+    done
+done
+echo "tm_test passed"
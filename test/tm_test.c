@@ -0,0 +1,87 @@
+/*
+ * Host checks of the scheduler behaviour. The tick is simulated by calling
+ * tmTick directly, a failed check prints its name and the exit code is 1.
+ *
+ * The options are compile-time ones, so the binary is built once per
+ * configuration, see run_tests.sh:
+ *  cc -O2 -I../taskman -DTM_TIMER_DEFERRED=1 \
+ *      tm_test.c ../taskman/taskman.c -o tm_test
+ */
+#include <stdio.h>
+#include "taskman.h"
+
+#if MAX_TIMERS < 2
+#error "tm_test needs two timers"
+#endif
+
+static uint32_t runsA;
+
+static void sTimerA(void) {
+    runsA++;
+}
+
+static void sStep(int ticks) {
+    for (int n = 0; n < ticks; n++) {
+        tmTick();
+        tmUpdate();
+    }
+}
+
+/*
+ * A deleted periodic timer must stop: it would otherwise keep reloading
+ * without a callback, wake the tickless idle and slow down the later runs
+ */
+static bool sCheckTimerDelete(void) {
+    uint32_t runs;
+    tmTimerStartPeriodic(10, TM_TIMER_FOREVER, sTimerA);
+    sStep(25);
+    tmTimerDelete(sTimerA);
+    runs = runsA;
+    sStep(1000);
+    if (runsA != runs) return false;
+    for (int i = 0; i < MAX_TIMERS; i++) {
+        if (tmSchedulerDefault.timers[i].active) return false;
+    }
+#if TM_TICKLESS
+    if (tmTicksToNextEvent() != TM_TICKS_INFINITE) return false;
+#endif
+    return true;
+}
+
+#if TM_TIMER_DEFERRED
+static uint32_t runsB;
+
+static void sTimerB(void) {
+    runsB++;
+}
+
+/*
+ * A timer deleted after the tick has queued it must not start, also when
+ * its slot is taken by a new timer before tmUpdate runs
+ */
+static bool sCheckDeleteExpired(void) {
+    runsA = 0;
+    tmTimerStartOnce(5, sTimerA);
+    for (int n = 0; n < 10 && tmSchedulerDefault.timerQueueHead == tmSchedulerDefault.timerQueueTail; n++) {
+        tmTick();
+    }
+    if (tmSchedulerDefault.timerQueueHead == tmSchedulerDefault.timerQueueTail) return false;
+    tmTimerDelete(sTimerA);
+    tmTimerStartOnce(5, sTimerB);
+    tmUpdate();
+    if (runsA || runsB) return false;
+    sStep(10);
+    tmTimerDelete(sTimerB);
+    return runsA == 0 && runsB == 1;
+}
+#endif // TM_TIMER_DEFERRED
+
+int main(void) {
+    int failed = 0;
+#define CHECK(f) if (!f()) { fprintf(stderr, "tm_test: %s failed\n", #f); failed = 1; }
+    CHECK(sCheckTimerDelete);
+#if TM_TIMER_DEFERRED
+    CHECK(sCheckDeleteExpired);
+#endif
+    return failed;
+}